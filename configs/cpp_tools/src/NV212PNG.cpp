@@ -1,15 +1,28 @@
-//#define ENABLE_TRACING
 #include <iostream>
 #include <fstream>
 #include <filesystem>
-#include <queue>
-#include <mutex>
-#include <condition_variable>
 #include <thread>
 #include <atomic>
-#include <regex>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <set>
+#include <cctype>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <new>
 #include <opencv2/opencv.hpp>
 #include "systrace.h"  // 包含Systrace头文件
+#include "concurrent_queue.h"
+#include "frame_pool.h"
+#include "frame_reader.h"
+#include "nv21_convert.h"
+#include "png_writer.h"
+#include "frame_manifest.h"
+#include "frame_archive.h"
+#include "memory_budget.h"
+#include "frame_scan.h"
 
 // 添加内存监控所需的头文件
 #ifdef __linux__
@@ -23,7 +36,7 @@ namespace fs = std::filesystem;
 
 // 获取当前进程内存使用量 (单位: KB)
 size_t get_current_memory_usage() {
-    //TRACE_FUNCTION();
+    //TRACE_FUNCTION(mem);
     size_t memory_usage = 0;
     
 #if defined(__linux__) || defined(__CYGWIN__)
@@ -49,70 +62,27 @@ size_t get_current_memory_usage() {
     return memory_usage;
 }
 
-// 线程安全的通用队列模板
-template <typename T>
-class ConcurrentQueue {
-public:
-    void push(T&& item) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        while (queue_.size() >= max_size) {
-            cond_producer_.wait(lock);
-        }
-        queue_.push(std::move(item));
-        cond_consumer_.notify_one();
-    }
-    
-    bool pop(T& item) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        while (queue_.empty() && !done_) {
-            cond_consumer_.wait(lock);
-        }
-        if (queue_.empty() && done_) {
-            return false;
-        }
-        item = std::move(queue_.front());
-        queue_.pop();
-        cond_producer_.notify_one();
-        return true;
-    }
-    
-    void setDone() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        done_ = true;
-        cond_consumer_.notify_all();
+// 进程的峰值内存占用（KB）
+size_t get_peak_memory_usage() {
+#if defined(__linux__) || defined(__CYGWIN__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return static_cast<size_t>(usage.ru_maxrss);    // Linux 上单位为 KB
     }
-    
-    size_t size() const {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return queue_.size();
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return static_cast<size_t>(pmc.PeakWorkingSetSize / 1024);
     }
+#endif
+    return 0;
+}
 
-private:
-    std::queue<T> queue_;
-    mutable std::mutex mutex_;
-    std::condition_variable cond_consumer_;
-    std::condition_variable cond_producer_;
-    std::atomic<bool> done_{false};
-    static const size_t max_size = 10; // 增大队列容量
-};
-
-// 解析YUV文件名获取宽度和高度
-bool parse_resolution(const std::string& filename, int& width, int& height) {
-    TRACE_FUNCTION();
-    // 改进的正则表达式 - 处理多种常见格式
-    std::regex pattern(R"([0-9A-Za-z_-]*PW(\d+)-PH(\d+))", std::regex_constants::icase);
-    
-    std::smatch matches;
-    if (std::regex_search(filename, matches, pattern) && matches.size() == 3) {
-        try {
-            width = std::stoi(matches[1]);
-            height = std::stoi(matches[2]);
-            return true;
-        } catch (...) {
-            return false;
-        }
-    }
-    return false;
+// 多帧文件中的帧序号，补零到 6 位，用于输出文件名和清单
+std::string frame_index_text(uint64_t index) {
+    char text[24];
+    std::snprintf(text, sizeof(text), "%06llu", static_cast<unsigned long long>(index));
+    return text;
 }
 
 // 文件信息结构
@@ -120,31 +90,709 @@ struct FileInfo {
     fs::path path;
     int width;
     int height;
-    std::string output_name;
+    std::string output_name;    // 相对输出目录的路径；多帧文件各帧输出名在扩展名前插入 _<帧序号>
+    uint64_t frame_id;          // 帧ID，跟踪中用于串联同一帧在各阶段的事件；多帧文件为第一帧的ID，其余依次加一
+    std::vector<uint64_t> frames;   // 多帧文件中要转换的帧序号，单帧文件为空
+    BudgetTicket budget{};          // 在文件队列中占用的内存预算，读取线程取出后归还
+
+    size_t frameCount() const { return frames.empty() ? 1 : frames.size(); }
+
+    // 第 k 个要转换的帧在文件中的偏移
+    uint64_t frameOffset(size_t k, size_t frame_size) const { return frames.empty() ? 0 : frames[k] * frame_size; }
+
+    std::string frameOutputName(size_t k) const {
+        if (frames.empty()) {
+            return output_name;
+        }
+        const fs::path name(output_name);
+        return (name.parent_path() / (name.stem().string() + "_" + frame_index_text(frames[k]) +
+                                      name.extension().string())).generic_string();
+    }
 };
 
 // YUV数据项
 struct YUVData {
-    std::vector<uint8_t> data;
+    FrameBuffer data;       // 来自 YUV 缓冲区池，转换完成后归还
     int width;
     int height;
     std::string output_name;
+    uint64_t frame_id;
+    BudgetTicket budget{};  // 本帧 YUV 与输出图像的内存预算，转换后归还 YUV 部分，其余随 ImageData 传给写入线程
+#ifdef FRAME_READER_POSIX
+    MappedFrame mapping{};  // mmap 输入时代替 data，转换完成后解除映射
+#endif
+
+    const uint8_t* pixels() const {
+#ifdef FRAME_READER_POSIX
+        if (mapping) return mapping.data();
+#endif
+        return data.data();
+    }
+
+    // 归还缓冲区或解除映射
+    void release() {
+        data.reset();
+#ifdef FRAME_READER_POSIX
+        mapping.reset();
+#endif
+    }
 };
 
 // 图像数据项
 struct ImageData {
-    cv::Mat image;
+    FrameBuffer buffer;     // 来自 BGR 缓冲区池，写入完成后归还
+    cv::Mat image;          // 引用 buffer 的图像，OpenCV 编码时为 BGR，zlib 编码时为 RGB
     std::string output_name;
+    uint64_t frame_id;
+    BudgetTicket budget{};  // 输出图像的内存预算，写入完成后归还
+};
+
+// 一个流水线阶段的工作线程组
+class WorkerPool {
+public:
+    // 等待的种类：Input 为等上游的数据（空闲），Output 为等下游队列、缓冲区池或内存预算（阻塞）
+    enum class Wait { Input, Output };
+
+    // 一个阶段所有线程的累计时间（秒）：busy = 线程运行时间 - idle - blocked
+    struct Times {
+        double busy = 0;
+        double idle = 0;
+        double blocked = 0;
+    };
+
+    // 计时一次等待，析构时计入对应的工作线程
+    class WaitTimer {
+    public:
+        WaitTimer(int64_t& total_ns) : total_ns_(total_ns), start_(std::chrono::steady_clock::now()) {}
+        WaitTimer(const WaitTimer&) = delete;
+        WaitTimer& operator=(const WaitTimer&) = delete;
+        ~WaitTimer() {
+            total_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_).count();
+        }
+
+    private:
+        int64_t& total_ns_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    WorkerPool(std::string name, size_t count) : name_(std::move(name)), processed_(count), times_(count) {}
+
+    // 启动所有工作线程，线程名为 <name>-<序号>，fn(worker) 为线程主体
+    template <typename Fn>
+    void start(Fn fn) {
+        for (size_t i = 0; i < processed_.size(); ++i) {
+            threads_.emplace_back([this, fn, i]() {
+                TRACE_SET_THREAD_NAME(name_ + "-" + std::to_string(i));
+                const auto start = std::chrono::steady_clock::now();
+                fn(i);
+                times_[i].run_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            });
+        }
+    }
+
+    // 计时工作线程 worker 的一次等待；只在该线程中使用
+    WaitTimer wait(size_t worker, Wait kind) {
+        return WaitTimer(kind == Wait::Input ? times_[worker].idle_ns : times_[worker].blocked_ns);
+    }
+
+    // join 之后调用
+    Times times() const {
+        Times total;
+        for (const auto& t : times_) {
+            total.busy += (t.run_ns - t.idle_ns - t.blocked_ns) / 1e9;
+            total.idle += t.idle_ns / 1e9;
+            total.blocked += t.blocked_ns / 1e9;
+        }
+        return total;
+    }
+
+    void join() {
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    size_t size() const { return processed_.size(); }
+
+    // 记录某个工作线程处理完一帧
+    void countItem(size_t worker) { ++processed_[worker]; }
+
+    // 每个工作线程已处理的帧数，例如 "3 4 2"
+    std::string progress() const {
+        std::string out;
+        for (const auto& count : processed_) {
+            if (!out.empty()) out += ' ';
+            out += std::to_string(count.load());
+        }
+        return out;
+    }
+
+private:
+    // 每个工作线程只写自己的一项，join 之后才读取
+    struct WorkerTimes {
+        int64_t run_ns = 0;
+        int64_t idle_ns = 0;
+        int64_t blocked_ns = 0;
+    };
+
+    std::string name_;
+    std::vector<std::atomic<int>> processed_;
+    std::vector<WorkerTimes> times_;
+    std::vector<std::thread> threads_;
+};
+
+// 解析工作线程数："auto" 返回 0，表示按 CPU 核数自动选择
+bool parse_worker_count(const char* text, size_t& count) {
+    if (std::string(text) == "auto") {
+        count = 0;
+        return true;
+    }
+    char* end = nullptr;
+    count = std::strtoul(text, &end, 10);
+    return *end == '\0' && count > 0;
+}
+
+// --frames 选择的多帧文件帧序号：[start, end) 中每隔 step 取一帧
+struct FrameRange {
+    uint64_t start = 0;
+    uint64_t end = UINT64_MAX;
+    uint64_t step = 1;
+
+    bool contains(uint64_t index) const {
+        return index >= start && index < end && (index - start) % step == 0;
+    }
 };
 
+// 解析 start:end:step，各部分可省略（例如 "100:"、":500"、"::10"）；单个数字表示只取这一帧
+bool parse_frame_range(const std::string& text, FrameRange& range) {
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    for (size_t colon; (colon = text.find(':', pos)) != std::string::npos; pos = colon + 1) {
+        parts.push_back(text.substr(pos, colon - pos));
+    }
+    parts.push_back(text.substr(pos));
+    if (parts.size() > 3) {
+        return false;
+    }
+    uint64_t* fields[] = {&range.start, &range.end, &range.step};
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (parts[i].empty()) {
+            continue;
+        }
+        if (!std::isdigit(static_cast<unsigned char>(parts[i][0]))) {
+            return false;
+        }
+        char* end = nullptr;
+        *fields[i] = std::strtoull(parts[i].c_str(), &end, 10);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    if (parts.size() == 1) {
+        range.end = range.start + 1;
+    }
+    return range.step > 0 && range.start < range.end;
+}
+
+// 解析 --size 的 <宽>x<高>，例如 "1920x1080"；宽高必须为偶数
+bool parse_frame_size(const std::string& text, int& width, int& height) {
+    char* end = nullptr;
+    const unsigned long w = std::strtoul(text.c_str(), &end, 10);
+    if (end == text.c_str() || (*end != 'x' && *end != 'X') || !std::isdigit(static_cast<unsigned char>(end[1]))) {
+        return false;
+    }
+    const unsigned long h = std::strtoul(end + 1, &end, 10);
+    if (*end != '\0' || w > 65536 || h > 65536) {
+        return false;
+    }
+    width = static_cast<int>(w);
+    height = static_cast<int>(h);
+    return Nv21Converter::validSize(width, height);
+}
+
+// 缩小倍数：至少为 scale，并使较长边不超过 max_dim（0 表示不限）；只取 2 的幂，不超过 kMaxScale，
+// 且输出至少保留 1 像素。超大帧在 kMaxScale 下仍超过 max_dim 时输出会大于 max_dim
+int choose_scale(int width, int height, int scale, int max_dim) {
+    int factor = scale;
+    while (max_dim > 0 && factor < Nv21Converter::kMaxScale && std::max(width, height) / factor > max_dim) {
+        factor *= 2;
+    }
+    while (factor > 1 && std::min(width, height) / factor == 0) {
+        factor /= 2;
+    }
+    return factor;
+}
+
+// 自动选择未指定的各阶段线程数：PNG 编码最耗时，其余核心都分给写入阶段
+void resolve_worker_counts(size_t& readers, size_t& converters, size_t& writers) {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    if (readers == 0) readers = std::clamp<size_t>(cores / 16, 1, 4);
+    if (converters == 0) converters = std::max<size_t>(1, cores / 8);
+    if (writers == 0) writers = cores > readers + converters ? cores - readers - converters : 1;
+}
+
+#ifdef FRAME_READER_POSIX
+/**
+ * io_uring 读取线程主体：同时保持最多 depth 帧的读请求在途，每完成一个就交给 push_frame。
+ * 多帧文件的各帧分别按偏移提交。
+ * 已有在途请求时只用不阻塞的 tryPop / tryAcquire，不会在自己持有的缓冲区或预算上等待；
+ * 没有在途请求时才阻塞等待新文件、空闲缓冲区或内存预算。frame_cost(width, height) 为一帧占用的预算。
+ */
+template <typename FrameCost, typename PushFrame>
+void read_files_uring(ConcurrentQueue<FileInfo>& file_queue, FramePool& pool, MemoryBudget& budget,
+                      FrameCost frame_cost, unsigned depth, WorkerPool& readers, size_t worker, PushFrame push_frame) {
+    struct Request {
+        fs::path path;
+        int width = 0;
+        int height = 0;
+        std::string output_name;
+        uint64_t frame_id = 0;
+        int fd = -1;
+        FrameBuffer buffer;
+        BudgetTicket budget;
+        uint64_t offset = 0;
+        size_t size = 0;
+        size_t done = 0;    // 已读字节数，短读时从这里继续
+    };
+
+    UringReader reader(depth);
+    std::vector<Request> requests(reader.depth());
+    std::vector<size_t> free_slots;
+    for (size_t i = requests.size(); i > 0; --i) {
+        free_slots.push_back(i - 1);
+    }
+    std::vector<ReadCompletion> completions;
+    size_t inflight = 0;
+    bool input_done = false;
+    bool has_pending = false;   // pending 中还有帧没有提交
+    FileInfo pending;
+    size_t pending_frame = 0;   // pending 中下一个要提交的帧
+
+    while (true) {
+        // 尽量填满提交队列
+        while (!input_done && !free_slots.empty()) {
+            if (!has_pending) {
+                TRACE_SCOPE(queue, "WaitForFileItem");
+                auto waiting = readers.wait(worker, WorkerPool::Wait::Input);
+                has_pending = inflight == 0 ? file_queue.pop(pending) : file_queue.tryPop(pending);
+                if (!has_pending) {
+                    input_done = inflight == 0;
+                    break;
+                }
+                TRACE_ASYNC_END(queue, "InFileQueue", pending.frame_id);
+                pending.budget.reset();
+                pending_frame = 0;
+            }
+
+            const size_t frame_size = pending.width * pending.height * 3 / 2;
+            const size_t cost = frame_cost(pending.width, pending.height);
+            BudgetTicket ticket;
+            FrameBuffer buffer;
+            if (inflight == 0) {
+                auto waiting = readers.wait(worker, WorkerPool::Wait::Output);
+                ticket = budget.acquire(cost);
+                buffer = pool.acquire(frame_size);
+            } else if (!budget.tryAcquire(cost, ticket) || !pool.tryAcquire(frame_size, buffer)) {
+                break;
+            }
+            const size_t k = pending_frame++;
+            has_pending = pending_frame < pending.frameCount();
+
+            const uint64_t frame_id = pending.frame_id + k;
+            TRACE_SCOPE_ARGS(io, "SubmitRead", TRACE_ARG("file", pending.frameOutputName(k)),
+                             TRACE_ARG("frame", frame_id));
+            int fd = ::open(pending.path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::cerr << "Error opening: " << pending.path << std::endl;
+                continue;
+            }
+            size_t slot = free_slots.back();
+            free_slots.pop_back();
+            Request& request = requests[slot];
+            request.path = pending.path;
+            request.width = pending.width;
+            request.height = pending.height;
+            request.output_name = pending.frameOutputName(k);
+            request.frame_id = frame_id;
+            request.fd = fd;
+            request.buffer = std::move(buffer);
+            request.budget = std::move(ticket);
+            request.offset = pending.frameOffset(k, frame_size);
+            request.size = frame_size;
+            request.done = 0;
+            TRACE_ASYNC_BEGIN(io, "InFlightRead", frame_id);
+            reader.submitRead(fd, request.buffer.data(), frame_size, request.offset, slot);
+            ++inflight;
+        }
+        if (inflight == 0) {
+            if (input_done) {
+                break;
+            }
+            continue;
+        }
+
+        completions.clear();
+        {
+            TRACE_SCOPE(io, "WaitForReads");
+            const bool was_using_uring = reader.usingUring();
+            reader.wait(completions);
+            if (was_using_uring && !reader.usingUring()) {
+                std::cerr << "io_uring_enter failed: " << std::strerror(reader.fallbackError())
+                          << ", falling back to pread" << std::endl;
+            }
+        }
+        for (const ReadCompletion& completion : completions) {
+            size_t slot = static_cast<size_t>(completion.user_data);
+            Request& request = requests[slot];
+            if (completion.result > 0 && request.done + completion.result < request.size) {
+                // 短读：继续读剩余部分
+                request.done += static_cast<size_t>(completion.result);
+                reader.submitRead(request.fd, request.buffer.data() + request.done, request.size - request.done,
+                                  request.offset + request.done, slot);
+                continue;
+            }
+            TRACE_ASYNC_END(io, "InFlightRead", request.frame_id);
+            ::close(request.fd);
+            request.fd = -1;
+            --inflight;
+            free_slots.push_back(slot);
+            if (completion.result <= 0) {
+                std::cerr << "Error reading: " << request.path << ": "
+                          << (completion.result < 0 ? std::strerror(static_cast<int>(-completion.result))
+                                                    : "file is shorter than one frame")
+                          << std::endl;
+                request.buffer.reset();
+                request.budget.reset();
+                continue;
+            }
+
+            TRACE_SCOPE_ARGS(io, "ReadFile", TRACE_ARG("file", request.output_name),
+                             TRACE_ARG("frame", request.frame_id));
+            TRACE_FLOW_BEGIN(pipeline, "Frame", request.frame_id);
+            push_frame(YUVData{std::move(request.buffer), request.width, request.height,
+                               std::move(request.output_name), request.frame_id, std::move(request.budget)});
+        }
+    }
+}
+#endif
+
+// 停止读取标准输入 / FIFO：第一次 Ctrl-C 读完当前帧后结束输入，已读的帧照常转换并写完归档；再按一次直接退出
+std::atomic<bool> stream_stop_requested(false);
+
+extern "C" void request_stream_stop(int signal_number) {
+    stream_stop_requested = true;
+    std::signal(signal_number, SIG_DFL);
+}
+
+/**
+ * 流输入的读取线程主体：从 stream 逐帧读满池中的缓冲区，交给 push_frame，直到输入结束或收到停止请求。
+ * 输出名为 frame_<帧序号><ext>，帧序号从 0 起按输入顺序计数；--frames 未选中的帧照常读出后丢弃。
+ * 预算和缓冲区池满时在此等待，管道随之写满，写入方被阻塞，内存占用不随输入时长增长。
+ * 返回读到的帧数（含未选中的帧）。
+ */
+template <typename PushFrame>
+uint64_t read_frame_stream(FrameStream& stream, int width, int height, const std::string& output_ext,
+                           const FrameRange& frame_range, FramePool& pool, MemoryBudget& budget, size_t cost,
+                           std::atomic<int>& frames_total, WorkerPool& readers, size_t worker, PushFrame push_frame) {
+    const size_t frame_size = static_cast<size_t>(width) * height * 3 / 2;
+    uint64_t index = 0;
+    for (; index < frame_range.end && !stream.cancelled(); ++index) {
+        const bool selected = frame_range.contains(index);
+        BudgetTicket ticket;
+        FrameBuffer buffer;
+        {
+            auto waiting = readers.wait(worker, WorkerPool::Wait::Output);
+            if (selected) {
+                ticket = budget.acquire(cost);
+            }
+            buffer = pool.acquire(frame_size);
+        }
+        size_t got;
+        {
+            // 实时输入时大部分时间在等写入方送来下一帧，计为空闲
+            TRACE_SCOPE_ARGS(io, "StreamRead", TRACE_ARG("index", index));
+            auto waiting = readers.wait(worker, WorkerPool::Wait::Input);
+            got = stream.read(buffer.data(), frame_size);
+        }
+        if (got < frame_size) {
+            if (!stream.error().empty()) {
+                std::cerr << "Error reading input stream: " << stream.error() << std::endl;
+            } else if (got > 0 && !stream.cancelled()) {
+                std::cerr << "Ignoring " << got << " trailing bytes (less than one frame)" << std::endl;
+            }
+            break;
+        }
+        if (!selected) {
+            continue;
+        }
+        const uint64_t frame_id = static_cast<uint64_t>(++frames_total);
+        YUVData item{std::move(buffer), width, height, "frame_" + frame_index_text(index) + output_ext, frame_id,
+                     std::move(ticket)};
+        TRACE_FLOW_BEGIN(pipeline, "Frame", item.frame_id);
+        push_frame(std::move(item));
+    }
+    return index;
+}
+
 int main(int argc, char* argv[]) {
     TRACE_SET_THREAD_NAME("MainThread");
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <directory_path>" << std::endl;
+    const char* dir_arg = nullptr;
+    size_t flight_mb = 0;
+    size_t reader_count = 0, converter_count = 0, writer_count = 0;
+    size_t frame_buffers = 0;
+    size_t max_memory = 0;      // 全流水线内存预算（字节），0 表示不限
+    InputBackend input_backend = InputBackend::Stream;
+    size_t io_depth = 32;
+    Nv21Kernel color_kernel = nv21_best_kernel();
+    YuvRange yuv_range = YuvRange::Limited;
+    bool zlib_png = false;      // 使用内置 zlib PNG 编码器代替 cv::imwrite
+    bool jpeg_output = false;   // 输出 JPEG 而不是 PNG
+    int jpeg_quality = -1;      // -1 表示 OpenCV 默认质量
+    int scale = 1;              // 缩小倍数，2 的幂
+    int max_dim = 0;            // 输出较长边上限，0 表示不限
+    int png_level = -1;         // -1 表示编码器默认级别
+    PngOptions png_options;
+    bool force = false;         // 忽略清单，重新转换所有输入
+    bool recursive = false;     // 扫描子目录，输出目录中保持相同的目录结构
+    size_t scan_threads = 0;    // 扫描目录的线程数，0 为自动
+    bool stream_input = false;  // 从标准输入或 FIFO 读取首尾相接的帧，而不是扫描目录
+    fs::path stream_path;       // FIFO 路径，为空时读取标准输入
+    int stream_width = 0, stream_height = 0;
+    fs::path stats_path;        // 结束时把运行统计写成 JSON，供 nv_bench 汇总
+    FrameRange frame_range;
+    ArchiveFormat archive_format = ArchiveFormat::None;
+    ArchiveSync archive_sync;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--trace" && i + 1 < argc) {
+            // 运行时选择跟踪类别，也可通过环境变量 SYSTRACE_CATEGORIES 设置
+            std::string categories = argv[++i];
+            if (!TRACE_ENABLE_CATEGORIES(categories)) {
+                std::cerr << "Invalid trace categories: " << categories << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--trace-mode" && i + 1 < argc) {
+            // record: 完整事件流；summary: 只输出各阶段耗时统计；both: 两者都要
+            std::string mode = argv[++i];
+            if (!TRACE_SET_MODE(mode)) {
+                std::cerr << "Invalid trace mode: " << mode << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--trace-perf") {
+            // 为每个跟踪作用域附加 perf_event_open 计数器增量，也可通过 SYSTRACE_PERF=1 开启
+            TRACE_SET_PERF_COUNTERS(true);
+        } else if (arg == "--trace-flight" && i + 1 < argc) {
+            // 飞行记录模式：只保留最近 N MB 的事件，进程崩溃后仍可从文件恢复
+            char* end = nullptr;
+            flight_mb = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || flight_mb == 0) {
+                std::cerr << "Invalid flight recorder size: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if ((arg == "--readers" || arg == "--converters" || arg == "--writers") && i + 1 < argc) {
+            size_t& count = arg == "--readers" ? reader_count : arg == "--converters" ? converter_count : writer_count;
+            if (!parse_worker_count(argv[++i], count)) {
+                std::cerr << "Invalid worker count for " << arg << ": " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--frame-buffers" && i + 1 < argc) {
+            // 每个缓冲区池的大小，即同时在途的帧数上限
+            if (!parse_worker_count(argv[++i], frame_buffers)) {
+                std::cerr << "Invalid frame buffer count: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--max-memory" && i + 1 < argc) {
+            // 各队列共享的内存预算，例如 512M：按帧的实际字节数而不是项数限制在途数据
+            if (!parse_byte_size(argv[++i], max_memory)) {
+                std::cerr << "Invalid memory size: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--input" && i + 1 < argc) {
+            // 输入方式：stream 逐个读入缓冲区池；mmap 直接映射文件；uring 批量异步读取
+            std::string backend = argv[++i];
+            if (!parse_input_backend(backend, input_backend)) {
+                std::cerr << "Invalid input backend: " << backend << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--io-depth" && i + 1 < argc) {
+            // uring 输入时每个读取线程同时在途的读请求数
+            char* end = nullptr;
+            io_depth = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || io_depth == 0 || io_depth > 4096) {
+                std::cerr << "Invalid io depth: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--color-kernel" && i + 1 < argc) {
+            // NV21 转 BGR 的内核，默认按 CPUID 选择最快的一个
+            std::string kernel = argv[++i];
+            if (!parse_nv21_kernel(kernel, color_kernel)) {
+                std::cerr << "Unsupported color kernel: " << kernel << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--yuv-range" && i + 1 < argc) {
+            // BT.601 取值范围：limited（默认，与 OpenCV 一致）或 full
+            std::string range = argv[++i];
+            if (range == "limited" || range == "full") {
+                yuv_range = range == "full" ? YuvRange::Full : YuvRange::Limited;
+            } else {
+                std::cerr << "Invalid YUV range: " << range << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--png-encoder" && i + 1 < argc) {
+            // opencv: cv::imwrite；zlib: 内置编码器，可选过滤方式并能把一帧分块并行压缩
+            std::string encoder = argv[++i];
+            if (encoder == "opencv" || encoder == "zlib") {
+                zlib_png = encoder == "zlib";
+            } else {
+                std::cerr << "Invalid PNG encoder: " << encoder << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--png-level" && i + 1 < argc) {
+            char* end = nullptr;
+            long level = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || level < 0 || level > 9) {
+                std::cerr << "Invalid PNG compression level: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+            png_level = static_cast<int>(level);
+        } else if (arg == "--png-filter" && i + 1 < argc) {
+            std::string filter = argv[++i];
+            if (!parse_png_filter(filter, png_options.filter)) {
+                std::cerr << "Invalid PNG filter: " << filter << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--png-threads" && i + 1 < argc) {
+            // zlib 编码器压缩一帧时使用的线程数（含写入线程自身）
+            size_t threads = 0;
+            if (!parse_worker_count(argv[++i], threads) || threads == 0) {
+                std::cerr << "Invalid PNG thread count: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+            png_options.threads = static_cast<unsigned>(threads);
+        } else if (arg == "--scale" && i + 1 < argc) {
+            // 缩小与颜色转换一步完成：亮度按 N×N 块取均值，与色度网格对齐，不生成全分辨率图像
+            char* end = nullptr;
+            long factor = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || factor < 1 || factor > Nv21Converter::kMaxScale || (factor & (factor - 1)) != 0) {
+                std::cerr << "Invalid scale (must be a power of two up to 64): " << argv[i] << std::endl;
+                usage_error = true;
+            }
+            scale = static_cast<int>(factor);
+        } else if (arg == "--max-dim" && i + 1 < argc) {
+            // 按每个输入的分辨率选择缩小倍数，使输出较长边不超过 N，用于生成预览图
+            char* end = nullptr;
+            long dim = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || dim < 1) {
+                std::cerr << "Invalid max dimension: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+            max_dim = static_cast<int>(dim);
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "png" || format == "jpg") {
+                jpeg_output = format == "jpg";
+            } else {
+                std::cerr << "Invalid output format: " << format << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--jpeg-quality" && i + 1 < argc) {
+            char* end = nullptr;
+            long quality = std::strtol(argv[++i], &end, 10);
+            if (*end != '\0' || quality < 1 || quality > 100) {
+                std::cerr << "Invalid JPEG quality: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+            jpeg_quality = static_cast<int>(quality);
+        } else if (arg == "--archive" && i + 1 < argc) {
+            // 所有帧编码后追加到输出目录中的一个归档，不再逐帧创建文件；用 nvarchive 列出或解开
+            std::string format = argv[++i];
+            if (!parse_archive_format(format, archive_format)) {
+                std::cerr << "Invalid archive format: " << format << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--archive-sync" && i + 1 < argc) {
+            // none: 不 fsync；close: 关闭前 fsync 一次；N: 每 N 帧 fsync 一次
+            std::string sync = argv[++i];
+            if (!parse_archive_sync(sync, archive_sync)) {
+                std::cerr << "Invalid archive sync policy: " << sync << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--force") {
+            force = true;
+        } else if (arg == "--stdin") {
+            stream_input = true;
+        } else if (arg == "--fifo" && i + 1 < argc) {
+            stream_input = true;
+            stream_path = argv[++i];
+        } else if (arg == "--size" && i + 1 < argc) {
+            // 流输入的帧尺寸，文件名中没有分辨率可解析
+            if (!parse_frame_size(argv[++i], stream_width, stream_height)) {
+                std::cerr << "Invalid frame size (WxH, even width and height): " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (arg == "--recursive") {
+            recursive = true;
+        } else if (arg == "--scan-threads" && i + 1 < argc) {
+            if (!parse_worker_count(argv[++i], scan_threads)) {
+                std::cerr << "Invalid scan thread count: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (arg == "--frames" && i + 1 < argc) {
+            // 多帧文件只转换选中的帧，直接定位到这些帧读取，跳过的帧不会读入
+            if (!parse_frame_range(argv[++i], frame_range)) {
+                std::cerr << "Invalid frame range: " << argv[i] << std::endl;
+                usage_error = true;
+            }
+        } else if (!dir_arg && arg.rfind("--", 0) != 0) {
+            dir_arg = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+    if (jpeg_output && zlib_png) {
+        std::cerr << "The zlib encoder only writes PNG" << std::endl;
+        usage_error = true;
+    }
+    if (stream_input && stream_width == 0) {
+        std::cerr << "--stdin and --fifo need --size WxH" << std::endl;
+        usage_error = true;
+    }
+    // 流输入时目录只用于存放输出，默认为当前目录
+    if (stream_input && !dir_arg) {
+        dir_arg = ".";
+    }
+    if (usage_error || !dir_arg) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--trace io,convert,queue,mem,pipeline|all] [--trace-mode record|summary|both]"
+                  << " [--trace-perf] [--trace-flight <MB>]"
+                  << " [--readers N|auto] [--converters N|auto] [--writers N|auto] [--frame-buffers N|auto]"
+                  << " [--max-memory SIZE[K|M|G]] [--input stream|mmap|uring] [--io-depth N]"
+                  << " [--color-kernel auto|scalar|sse4.1|avx2|avx512] [--yuv-range limited|full]"
+                  << " [--png-encoder opencv|zlib] [--png-level 0..9]"
+                  << " [--png-filter none|sub|up|adaptive] [--png-threads N] [--force]"
+                  << " [--recursive] [--scan-threads N|auto] [--stdin | --fifo <path>] [--size WxH]"
+                  << " [--stats-json <path>]"
+                  << " [--frames start:end:step] [--scale 1|2|4|...] [--max-dim N]"
+                  << " [--format png|jpg] [--jpeg-quality 1..100]"
+                  << " [--archive tar|pack] [--archive-sync none|close|N]"
+                  << " <directory_path>" << std::endl
+                  << "       " << argv[0] << " --stdin|--fifo <path> --size WxH [options] [output_directory]"
+                  << std::endl;
         return EXIT_FAILURE;
     }
+#ifdef ENABLE_TRACING
+    // 只要求统计而未指定类别时，统计所有阶段
+    if (Systrace::summarizing() && !Systrace::anyEnabled()) {
+        Systrace::setEnabledCategories(kTraceCatAll);
+    }
+#endif
 
-    fs::path dir_path(argv[1]);
+    fs::path dir_path(dir_arg);
     if (!fs::exists(dir_path) || !fs::is_directory(dir_path)) {
         std::cerr << "Invalid directory: " << dir_path << std::endl;
         return EXIT_FAILURE;
@@ -154,250 +802,608 @@ int main(int argc, char* argv[]) {
     fs::path output_dir = dir_path / "pngs";
     fs::create_directories(output_dir);
 
-    // 创建队列
-    ConcurrentQueue<FileInfo> file_queue;   // 文件信息队列
-    ConcurrentQueue<YUVData> yuv_queue;     // YUV数据队列
-    ConcurrentQueue<ImageData> image_queue; // 图像队列
+    // 事件由后台线程流式写入二进制文件，内存占用有上限；用 systrace2json 转换为 JSON
+    // 飞行记录模式下事件写入 mmap 文件中的环形缓冲区，崩溃后用 systrace2json 恢复
+    if (TRACE_RECORDING()) {
+        if (flight_mb > 0) {
+            TRACE_START_FLIGHT_RECORDER(dir_path / "conversion_trace.flight", flight_mb << 20);
+        } else {
+            TRACE_START_STREAMING(dir_path / "conversion_trace.bin", Systrace::kDefaultStreamMemory);
+        }
+    }
+
+    // 各阶段工作线程数
+    resolve_worker_counts(reader_count, converter_count, writer_count);
+    if (stream_input) {
+        reader_count = 1;   // 流只能顺序读取
+    }
+    std::cout << "Workers: " << reader_count << " readers, " << converter_count << " converters, "
+              << writer_count << " writers" << std::endl;
+    // zlib 编码器直接使用 RGB，省去编码前的通道交换
+    const Nv21Converter color_converter(color_kernel, yuv_range, zlib_png ? PixelOrder::RGB : PixelOrder::BGR);
+    if (png_level >= 0) {
+        png_options.level = png_level;
+    }
+    std::vector<int> imwrite_params;
+    if (jpeg_output) {
+        if (jpeg_quality > 0) {
+            imwrite_params = {cv::IMWRITE_JPEG_QUALITY, jpeg_quality};
+        }
+    } else if (png_level >= 0) {
+        imwrite_params = {cv::IMWRITE_PNG_COMPRESSION, png_level};
+    }
+    const std::string output_ext = jpeg_output ? ".jpg" : ".png";
+    std::cout << "Color kernel: " << nv21_kernel_name(color_converter.kernel()) << std::endl;
+
+    // 转换清单：跳过上次已转换且未变化的输入，相同内容的帧复用已有输出。
+    // 设置中只包含影响输出内容的参数，线程数、内核等不影响结果的参数变化时不会重新转换
+    const std::string manifest_settings =
+        std::string("encoder=") + (zlib_png ? "zlib" : "opencv") +
+        " level=" + (png_level >= 0 ? std::to_string(png_level) : "default") +
+        (zlib_png ? std::string(" filter=") + png_filter_name(png_options.filter) : "") +
+        " range=" + (yuv_range == YuvRange::Full ? "full" : "limited") +
+        (jpeg_output ? " format=jpg quality=" + (jpeg_quality > 0 ? std::to_string(jpeg_quality) : "default") : "") +
+        (scale > 1 ? " scale=" + std::to_string(scale) : "") +
+        (max_dim > 0 ? " max-dim=" + std::to_string(max_dim) : "");
+    const fs::path manifest_path = output_dir / FrameManifest::kFileName;
+    FrameManifest manifest(manifest_settings);
+    // 归档每次重新写出，清单中的单个输出文件对它没有意义：归档模式下不跳过、不复用、不更新清单；
+    // 流输入的帧没有文件大小和修改时间可比较，同样不用清单
+    const bool use_manifest = archive_format == ArchiveFormat::None && !stream_input;
+    if (!use_manifest) {
+        force = true;
+    }
+    if (!force && !manifest.load(manifest_path) && fs::exists(manifest_path)) {
+        std::cout << "Output settings changed, converting all files" << std::endl;
+    }
+
+    ArchiveWriter archive(archive_format, archive_sync);
+    const fs::path archive_path = output_dir / (std::string("frames") + archive_extension(archive_format));
+    const int64_t archive_mtime = static_cast<int64_t>(std::time(nullptr));
+    if (archive_format != ArchiveFormat::None) {
+        std::string error;
+        if (!archive.open(archive_path, error)) {
+            std::cerr << "Error creating archive: " << archive_path << ": " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // 内存预算：文件项入队时、帧被读取线程接纳时按字节借出，下游处理完逐步归还。
+    // 一帧的预算包含 YUV 输入和（缩小后的）输出图像，在读取前一次借足，流水线中途不再等待预算
+    MemoryBudget budget(max_memory);
+    auto frame_cost = [&](int width, int height) {
+        const int factor = choose_scale(width, height, scale, max_dim);
+        return static_cast<size_t>(width) * height * 3 / 2 +
+               static_cast<size_t>(Nv21Converter::scaledSize(width, factor)) * Nv21Converter::scaledSize(height, factor) * 3;
+    };
+
+    // 流输入：在启动工作线程前打开，打开 FIFO 会一直等到写入方出现
+    FrameStream stream(&stream_stop_requested);
+    uint64_t stream_frames_read = 0;
+    if (stream_input) {
+        std::signal(SIGINT, request_stream_stop);
+        std::signal(SIGTERM, request_stream_stop);
+        if (!stream.open(stream_path)) {
+            std::cerr << "Error opening input stream " << (stream_path.empty() ? "<stdin>" : stream_path.string())
+                      << ": " << stream.error() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    const auto start_time = std::chrono::steady_clock::now();
+
+    // 创建队列：生产者数为上一阶段的线程数，容量至少能让每个消费者都有一项在等待。
+    // 设置了内存预算时由预算限制在途数据，项数容量只是防止小帧无限堆积的上限
+    constexpr size_t kBudgetQueueCapacity = 1024;
+    auto capacity = [&](size_t consumers) {
+        return std::max(max_memory ? kBudgetQueueCapacity : ConcurrentQueue<FileInfo>::kDefaultCapacity, consumers * 2);
+    };
+    ConcurrentQueue<FileInfo> file_queue(1, reader_count, capacity(reader_count));                    // 文件信息队列
+    ConcurrentQueue<YUVData> yuv_queue(reader_count, converter_count, capacity(converter_count));     // YUV数据队列
+    ConcurrentQueue<ImageData> image_queue(converter_count, writer_count, capacity(writer_count));    // 图像队列
+    // 帧缓冲区池：读取线程从 YUV 池借缓冲区，转换线程从 BGR 池借缓冲区。
+    // 两个池分开，转换线程持有 YUV 缓冲区等待 BGR 缓冲区时不会与读取线程互相等待；
+    // 池满时借用方阻塞，池大小即流水线的背压上限；设置了内存预算时池的总字节数也不超过预算
+    FramePool yuv_pool(frame_buffers ? frame_buffers : reader_count + converter_count + capacity(converter_count),
+                       max_memory);
+    FramePool bgr_pool(frame_buffers ? frame_buffers : converter_count + writer_count + capacity(writer_count),
+                       max_memory);
+
+    WorkerPool readers("ReaderThread", reader_count);
+    WorkerPool converters("ConverterThread", converter_count);
+    WorkerPool writers("WriterThread", writer_count);
 
     // 原子计数器用于进度监控
     std::atomic<int> files_processed(0);
     std::atomic<int> files_total(0);
+    std::atomic<int> files_skipped(0);         // 未变化而跳过
+    std::atomic<int> files_deduplicated(0);    // 复用相同内容的已有输出
+    std::atomic<uint64_t> input_bytes(0);      // 转换线程处理过的 YUV 字节数
     std::atomic<bool> running(true);
 
     // 进度监控线程
     auto monitor_thread = std::thread([&]() {
         TRACE_SET_THREAD_NAME("MonitorThread");
-        TRACE_INSTANT("MonitorThreadStart");
+        TRACE_INSTANT(pipeline, "MonitorThreadStart");
         while (running || file_queue.size() > 0 || yuv_queue.size() > 0 || image_queue.size() > 0) {
             {
-                TRACE_SCOPE("MonitorSleep");
+                TRACE_SCOPE(pipeline, "MonitorSleep");
                 std::this_thread::sleep_for(std::chrono::seconds(1));
             }
             
-            // 获取并记录内存使用情况
+            // 获取并记录内存使用情况：/proc 只在这里低频采样，各流水线线程不再逐帧读取
             size_t mem_usage = get_current_memory_usage();
             
             std::cout << "\rProgress: " 
-                      << files_processed << "/" << files_total << " files | "
+                      << files_processed << "/" << files_total << " frames | "
                       << "FileQ: " << file_queue.size() << " | "
                       << "YUVQ: " << yuv_queue.size() << " | "
                       << "ImgQ: " << image_queue.size() << " | "
+                      << "R[" << readers.progress() << "] C[" << converters.progress()
+                      << "] W[" << writers.progress() << "] | "
+                      << "Buf: " << yuv_pool.inUse() << "/" << yuv_pool.capacity() << " "
+                      << bgr_pool.inUse() << "/" << bgr_pool.capacity() << " | "
+                      << "Budget: " << (budget.used() >> 10);
+            if (budget.limit()) {
+                std::cout << "/" << (budget.limit() >> 10);
+            }
+            std::cout << " KB (peak " << (budget.peak() >> 10) << " KB) | "
                       << "Mem: " << mem_usage << " KB     " << std::flush;
         }
         std::cout << "\nProcessing completed." << std::endl;
-        TRACE_INSTANT("MonitorThreadEnd");
+        TRACE_INSTANT(pipeline, "MonitorThreadEnd");
     });
 
     // 启动文件读取线程
-	auto reader_thread = std::thread([&]() {
-		TRACE_SET_THREAD_NAME("ReaderThread");
-		TRACE_INSTANT("ReaderThreadStart");
+	readers.start([&](size_t worker) {
+		TRACE_INSTANT(pipeline, "ReaderThreadStart");
 		
-		FileInfo file_info;
-		while (true) {
-			// 记录等待开始
-			TRACE_BEGIN("WaitForFileItem");
-			
-			// 实际 pop 操作
-			if (!file_queue.pop(file_info)) {
-				TRACE_END("WaitForFileItem");
-				break;
-			}
-			
-			// 记录等待结束
-			TRACE_END("WaitForFileItem");
-			
-			std::string trace_args = "{\"file\":\"" + file_info.path.filename().string() + "\"}";
-			TRACE_SCOPE_ARGS("ReadFile", trace_args);
+		// 放入YUV队列
+		auto push_frame = [&](YUVData&& item) {
+			TRACE_SCOPE(queue, "PushToYUVQueue");
+			TRACE_ASYNC_BEGIN(queue, "InYUVQueue", item.frame_id);
+			auto waiting = readers.wait(worker, WorkerPool::Wait::Output);
+			yuv_queue.push(std::move(item));
+			TRACE_INSTANT(queue, "YUVQueuePushed");
+			readers.countItem(worker);
+		};
+		auto acquire_budget = [&](size_t cost) {
+			auto waiting = readers.wait(worker, WorkerPool::Wait::Output);
+			return budget.acquire(cost);
+		};
+		
+		if (stream_input) {
+			stream_frames_read = read_frame_stream(stream, stream_width, stream_height, output_ext, frame_range,
+			                                       yuv_pool, budget, frame_cost(stream_width, stream_height),
+			                                       files_total, readers, worker, push_frame);
+		} else
+#ifdef FRAME_READER_POSIX
+		if (input_backend == InputBackend::Uring) {
+			read_files_uring(file_queue, yuv_pool, budget, frame_cost, static_cast<unsigned>(io_depth), readers, worker,
+			                 push_frame);
+		} else
+#endif
+		{
+			FileInfo file_info;
+			while (true) {
+				bool got_item;
+				{
+					TRACE_SCOPE(queue, "WaitForFileItem");
+					auto waiting = readers.wait(worker, WorkerPool::Wait::Input);
+					got_item = file_queue.pop(file_info);
+				}
+				if (!got_item) {
+					break;
+				}
+				TRACE_ASYNC_END(queue, "InFileQueue", file_info.frame_id);
+				file_info.budget.reset();
 			
-			// 计算帧大小 (I420格式)
-			const size_t frame_size = file_info.width * file_info.height * 3 / 2;
+				// 计算帧大小 (I420格式)
+				const size_t frame_size = file_info.width * file_info.height * 3 / 2;
+				const size_t cost = frame_cost(file_info.width, file_info.height);
 			
-			{
-				TRACE_SCOPE("FileOpen");
-				std::ifstream file(file_info.path, std::ios::binary);
-				
-				if (!file) {
-					std::cerr << "Error opening: " << file_info.path << std::endl;
+#ifdef FRAME_READER_POSIX
+				if (input_backend == InputBackend::Mmap) {
+					// 映射文件，转换线程直接读取页缓存，不占用 YUV 缓冲区池
+					for (size_t k = 0; k < file_info.frameCount(); ++k) {
+						YUVData item{FrameBuffer(), file_info.width, file_info.height, file_info.frameOutputName(k),
+						             file_info.frame_id + k, acquire_budget(cost)};
+						TRACE_SCOPE_ARGS(io, "ReadFile", TRACE_ARG("file", item.output_name),
+						                 TRACE_ARG("frame", item.frame_id));
+						TRACE_FLOW_BEGIN(pipeline, "Frame", item.frame_id);
+						{
+							TRACE_SCOPE(io, "FileMap");
+							std::string error;
+							if (!item.mapping.open(file_info.path, frame_size, error, file_info.frameOffset(k, frame_size))) {
+								std::cerr << "Error mapping: " << file_info.path << ": " << error << std::endl;
+								continue;
+							}
+						}
+						push_frame(std::move(item));
+					}
 					continue;
 				}
-				
-				// 读取文件内容
-				std::vector<uint8_t> buffer(frame_size);
+#endif
+				FrameFile file;
 				{
-					TRACE_SCOPE("FileRead");
-					if (!file.read(reinterpret_cast<char*>(buffer.data()), frame_size)) {
-						std::cerr << "Error reading: " << file_info.path << std::endl;
+					TRACE_SCOPE(io, "FileOpen");
+					if (!file.open(file_info.path)) {
+						std::cerr << "Error opening: " << file_info.path << std::endl;
 						continue;
 					}
 				}
+				// 多帧文件逐帧读取：每帧占用一个池缓冲区，预算、池和 YUV 队列满时在此等待，内存不随文件大小增长
+				for (size_t k = 0; k < file_info.frameCount(); ++k) {
+					YUVData item{FrameBuffer(), file_info.width, file_info.height, file_info.frameOutputName(k),
+					             file_info.frame_id + k, acquire_budget(cost)};
+					TRACE_SCOPE_ARGS(io, "ReadFile", TRACE_ARG("file", item.output_name),
+					                 TRACE_ARG("frame", item.frame_id));
+					TRACE_FLOW_BEGIN(pipeline, "Frame", item.frame_id);
+					// 让内核在等待缓冲区和读取本帧的同时预读下一个选中的帧
+					if (k + 1 < file_info.frameCount()) {
+						file.willNeed(file_info.frameOffset(k + 1, frame_size), frame_size);
+					}
 				
-				// 记录内存使用量
-				size_t mem_usage = get_current_memory_usage();
-				TRACE_MEMORY(mem_usage);
-				
-				// 放入YUV队列
-				{
-					TRACE_SCOPE("PushToYUVQueue");
-					yuv_queue.push({
-						std::move(buffer),
-						file_info.width,
-						file_info.height,
-						file_info.output_name
-					});
-					TRACE_INSTANT("YUVQueuePushed");
+					// 读取文件内容到池中的缓冲区，池满时在此等待下游归还
+					{
+						auto waiting = readers.wait(worker, WorkerPool::Wait::Output);
+						item.data = yuv_pool.acquire(frame_size);
+					}
+					{
+						TRACE_SCOPE(io, "FileRead");
+						if (!file.read(item.data.data(), frame_size, file_info.frameOffset(k, frame_size))) {
+							std::cerr << "Error reading: " << file_info.path << std::endl;
+							continue;
+						}
+					}
+					push_frame(std::move(item));
 				}
 			}
 		}
-		TRACE_INSTANT("ReaderThreadEnd");
-		yuv_queue.setDone();
+		TRACE_INSTANT(pipeline, "ReaderThreadEnd");
+		yuv_queue.producerDone();
 	});
 
     // 启动转换线程
-	auto converter_thread = std::thread([&]() {
-		TRACE_SET_THREAD_NAME("ConverterThread");
-		TRACE_INSTANT("ConverterThreadStart");
+	converters.start([&](size_t worker) {
+		TRACE_INSTANT(pipeline, "ConverterThreadStart");
 		
 		YUVData yuv_item;
 		while (true) {
-			// 记录等待开始
-			TRACE_BEGIN("WaitForYUVItem");
-			
-			// 实际 pop 操作
-			if (!yuv_queue.pop(yuv_item)) {
-				TRACE_END("WaitForYUVItem");
+			bool got_item;
+			{
+				TRACE_SCOPE(queue, "WaitForYUVItem");
+				auto waiting = converters.wait(worker, WorkerPool::Wait::Input);
+				got_item = yuv_queue.pop(yuv_item);
+			}
+			if (!got_item) {
 				break;
 			}
+			TRACE_ASYNC_END(queue, "InYUVQueue", yuv_item.frame_id);
+			input_bytes += static_cast<uint64_t>(yuv_item.width) * yuv_item.height * 3 / 2;
 			
-			// 记录等待结束
-			TRACE_END("WaitForYUVItem");
+			TRACE_SCOPE_ARGS(convert, "ConvertYUV", TRACE_ARG("file", yuv_item.output_name),
+			                 TRACE_ARG("frame", yuv_item.frame_id));
+			TRACE_FLOW_STEP(pipeline, "Frame", yuv_item.frame_id);
 			
-			std::string trace_args = "{\"file\":\"" + yuv_item.output_name + "\"}";
-			TRACE_SCOPE_ARGS("ConvertYUV", trace_args);
+			// 按内容哈希查找已有的相同帧输出，找到则直接链接过去，不再转换和编码
+			uint64_t hash = 0;
+			if (use_manifest) {
+				TRACE_SCOPE(convert, "HashFrame");
+				hash = frame_hash(yuv_item.pixels(), static_cast<size_t>(yuv_item.width) * yuv_item.height * 3 / 2,
+				                  yuv_item.width, yuv_item.height);
+			}
+			std::string existing;
+			if (use_manifest && manifest.findDuplicate(yuv_item.frame_id, hash, output_dir, existing)) {
+				TRACE_SCOPE_ARGS(io, "ReuseOutput", TRACE_ARG("from", existing));
+				std::string error;
+				if (existing == yuv_item.output_name ||
+				    reuse_output(output_dir / existing, output_dir / yuv_item.output_name, error)) {
+					manifest.commit(yuv_item.frame_id, yuv_item.output_name);
+					TRACE_FLOW_END(pipeline, "Frame", yuv_item.frame_id);
+					yuv_item.release();
+					yuv_item.budget.reset();
+					converters.countItem(worker);
+					files_deduplicated++;
+					files_processed++;
+					continue;
+				}
+				std::cerr << "Error reusing " << existing << " for " << yuv_item.output_name << ": " << error << std::endl;
+			}
 			
 			try {
-				// 创建YUV矩阵 (I420格式)
-				cv::Mat yuv_mat(yuv_item.height * 3/2, yuv_item.width, CV_8UC1, yuv_item.data.data());
-				cv::Mat bgr;
-				
+				// 输出直接逐行写入池中的缓冲区；缩小时在转换的同时完成，缓冲区只有缩小后的大小。
+				// 仍保留整帧缓冲区而不在写入线程中按条带转换进编码器：转换和编码分属两个阶段各自并行，
+				// OpenCV / JPEG 编码和归档需要完整的 cv::Mat，YUV 缓冲区和预算在转换后就能归还；
+				// 内置 zlib 编码器直接从这块缓冲区过滤，中间没有额外拷贝
+				const int factor = choose_scale(yuv_item.width, yuv_item.height, scale, max_dim);
+				const int out_width = Nv21Converter::scaledSize(yuv_item.width, factor);
+				const int out_height = Nv21Converter::scaledSize(yuv_item.height, factor);
+				const size_t bgr_stride = static_cast<size_t>(out_width) * 3;
+				FrameBuffer bgr_buffer;
 				{
-					TRACE_SCOPE("ColorConversion");
-					cv::cvtColor(yuv_mat, bgr, cv::COLOR_YUV2BGR_NV21);
+					auto waiting = converters.wait(worker, WorkerPool::Wait::Output);
+					bgr_buffer = bgr_pool.acquire(bgr_stride * out_height);
 				}
-				
-				// 记录内存使用量
-				size_t mem_usage = get_current_memory_usage();
-				TRACE_MEMORY(mem_usage);
+				{
+					TRACE_SCOPE(convert, "ColorConversion");
+					color_converter.convertScaled(yuv_item.pixels(), yuv_item.width, yuv_item.height, factor,
+					                              bgr_buffer.data(), bgr_stride);
+				}
+				cv::Mat bgr(out_height, out_width, CV_8UC3, bgr_buffer.data());
+				// YUV 缓冲区已用完，尽早归还给读取线程，预算中只留下输出图像的部分
+				yuv_item.release();
+				yuv_item.budget.release(static_cast<size_t>(yuv_item.width) * yuv_item.height * 3 / 2);
 				
 				{
-					TRACE_SCOPE("PushToImageQueue");
-					image_queue.push({std::move(bgr), yuv_item.output_name});
-					TRACE_INSTANT("ImageQueuePushed");
+					TRACE_SCOPE(queue, "PushToImageQueue");
+					TRACE_ASYNC_BEGIN(queue, "InImageQueue", yuv_item.frame_id);
+					auto waiting = converters.wait(worker, WorkerPool::Wait::Output);
+					image_queue.push({std::move(bgr_buffer), std::move(bgr), yuv_item.output_name, yuv_item.frame_id,
+					                  std::move(yuv_item.budget)});
+					TRACE_INSTANT(queue, "ImageQueuePushed");
 				}
-			} catch (const cv::Exception& e) {
-				std::cerr << "Conversion error: " << e.what() << std::endl;
+				converters.countItem(worker);
+			} catch (const std::bad_alloc&) {
+				std::cerr << "Conversion error: out of memory for " << yuv_item.output_name << std::endl;
 			}
+			yuv_item.release();
+			yuv_item.budget.reset();
 		}
-		TRACE_INSTANT("ConverterThreadEnd");
-		image_queue.setDone();
+		TRACE_INSTANT(pipeline, "ConverterThreadEnd");
+		image_queue.producerDone();
 	});
 	
     // 启动写入线程
-	auto writer_thread = std::thread([&]() {
-		TRACE_SET_THREAD_NAME("WriterThread");
-		TRACE_INSTANT("WriterThreadStart");
+	writers.start([&](size_t worker) {
+		TRACE_INSTANT(pipeline, "WriterThreadStart");
 		
+		PngEncoder png_encoder(png_options);     // 每个写入线程一个，复用压缩缓冲区
+		std::vector<uint8_t> encoded;           // 归档模式下编码到内存，复用
 		ImageData img_item;
 		while (true) {
-			// 记录等待开始
-			TRACE_BEGIN("WaitForImageItem");
-			
-			// 实际 pop 操作
-			if (!image_queue.pop(img_item)) {
-				TRACE_END("WaitForImageItem");
+			bool got_item;
+			{
+				TRACE_SCOPE(queue, "WaitForImageItem");
+				auto waiting = writers.wait(worker, WorkerPool::Wait::Input);
+				got_item = image_queue.pop(img_item);
+			}
+			if (!got_item) {
 				break;
 			}
+			TRACE_ASYNC_END(queue, "InImageQueue", img_item.frame_id);
 			
-			// 记录等待结束
-			TRACE_END("WaitForImageItem");
+			TRACE_SCOPE_ARGS(io, "WritePNG", TRACE_ARG("file", img_item.output_name),
+			                 TRACE_ARG("frame", img_item.frame_id));
+			TRACE_FLOW_END(pipeline, "Frame", img_item.frame_id);
 			
-			std::string trace_args = "{\"file\":\"" + img_item.output_name + "\"}";
-			TRACE_SCOPE_ARGS("WritePNG", trace_args);
+			if (archive_format != ArchiveFormat::None) {
+				// 编码到内存后追加到归档，多个写入线程并行编码，只有追加是串行的
+				std::string error;
+				bool encoded_ok;
+				{
+					TRACE_SCOPE(io, "ImageEncode");
+					if (zlib_png) {
+						encoded_ok = png_encoder.encode(img_item.buffer.data(), img_item.image.cols, img_item.image.rows,
+						                                static_cast<size_t>(img_item.image.cols) * 3, encoded, error);
+					} else {
+						try {
+							encoded_ok = cv::imencode(output_ext, img_item.image, encoded, imwrite_params);
+						} catch (const cv::Exception& e) {
+							encoded_ok = false;
+							error = e.what();
+						}
+					}
+				}
+				// 归还 BGR 缓冲区，不必等追加完成
+				img_item.image = cv::Mat();
+				img_item.buffer.reset();
+				img_item.budget.reset();
+				if (encoded_ok) {
+					TRACE_SCOPE(io, "ArchiveAppend");
+					auto waiting = writers.wait(worker, WorkerPool::Wait::Output);
+					encoded_ok = archive.append(img_item.output_name, encoded.data(), encoded.size(), archive_mtime, error);
+				}
+				if (!encoded_ok) {
+					std::cerr << "Error writing " << img_item.output_name << " to archive: " << error << std::endl;
+				}
+				writers.countItem(worker);
+				files_processed++;
+				continue;
+			}
 			
 			try {
+				// 先写临时文件再改名：中途失败不会留下不完整的 PNG，也不会改动与之硬链接的其他输出
 				fs::path output_path = output_dir / img_item.output_name;
+				fs::path partial_path = partial_output_path(output_path);
+				bool written = false;
 				{
-					TRACE_SCOPE("ImageWrite");
-					if (!cv::imwrite(output_path.string(), img_item.image)) {
-						std::cerr << "Error writing: " << output_path << std::endl;
+					TRACE_SCOPE(io, "ImageWrite");
+					if (zlib_png) {
+						std::string error;
+						written = png_encoder.write(partial_path, img_item.buffer.data(), img_item.image.cols,
+						                            img_item.image.rows, static_cast<size_t>(img_item.image.cols) * 3, error);
+						if (!written) {
+							std::cerr << "Error writing: " << output_path << ": " << error << std::endl;
+						}
+					} else {
+						written = cv::imwrite(partial_path.string(), img_item.image, imwrite_params);
+						if (!written) {
+							std::cerr << "Error writing: " << output_path << std::endl;
+						}
 					}
 				}
+				if (written) {
+					fs::rename(partial_path, output_path);
+					manifest.commit(img_item.frame_id, img_item.output_name);
+				}
 				
-				// 记录内存使用量
-				size_t mem_usage = get_current_memory_usage();
-				TRACE_MEMORY(mem_usage);
-				
+				writers.countItem(worker);
 				files_processed++;
 			} catch (const std::exception& e) {
 				std::cerr << "Write error: " << e.what() << std::endl;
 			}
+			// 归还 BGR 缓冲区和预算，不要等到下一次 pop 覆盖时才释放
+			img_item.image = cv::Mat();
+			img_item.buffer.reset();
+			img_item.budget.reset();
 		}
-		TRACE_INSTANT("WriterThreadEnd");
+		TRACE_INSTANT(pipeline, "WriterThreadEnd");
 	});
 
-    // 主线程：仅遍历目录并收集文件信息
-    TRACE_INSTANT("MainThreadStart");
-    {
-        TRACE_SCOPE("DirectoryScan");
-        for (const auto& entry : fs::directory_iterator(dir_path)) {
-            if (!entry.is_regular_file()) continue;
-            
-            const fs::path& file_path = entry.path();
-            if (file_path.extension() != ".nv21" && file_path.extension() != ".NV21") {
-                continue;
-            }
-            
-            int width = 0, height = 0;
-            if (!parse_resolution(file_path.filename().string(), width, height)) {
+    // 主线程：接收扫描线程边遍历边交出的文件，查清单后放入文件队列，不必等整个目录扫描完
+    TRACE_INSTANT(pipeline, "MainThreadStart");
+    if (!stream_input) {
+        TRACE_SCOPE(pipeline, "DirectoryScan");
+        FrameScanner scanner(dir_path, recursive,
+                             scan_threads ? scan_threads : std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 8),
+                             output_dir.filename().string());
+        std::set<std::string> output_subdirs;     // 已创建的输出子目录
+        ScanEntry entry;
+        while (scanner.next(entry)) {
+            // 清单键和输出名都用相对输入目录的路径，递归扫描时输出目录保持相同的目录结构
+            const fs::path relative_path(entry.relative_path);
+            const fs::path file_path = dir_path / relative_path;
+            const int width = entry.width, height = entry.height;
+            if (!Nv21Converter::validSize(width, height)) {
                 std::cerr << "Skipping invalid file: " << file_path << std::endl;
                 continue;
             }
             
-            // 生成输出文件名
-            std::string output_name = file_path.stem().string() + ".png";
+            const uint64_t file_size = entry.size;
+            const int64_t mtime_ns = entry.mtime_ns;
+            const std::string& input_name = entry.relative_path;
+            const uint64_t frame_id = static_cast<uint64_t>(files_total) + 1;
+            const uint64_t frame_size = static_cast<uint64_t>(width) * height * 3 / 2;
+            const uint64_t frame_count = file_size / frame_size;
+            FileInfo file_info{file_path, width, height,
+                               (relative_path.parent_path() / (relative_path.stem().string() + output_ext)).generic_string(),
+                               frame_id, {}};
             
-            // 放入文件队列（仅元数据）
-            {
-                TRACE_SCOPE("PushToFileQueue");
-                file_queue.push({file_path, width, height, output_name});
+            if (frame_count > 1) {
+                // 多帧文件：每帧单独记入清单（键为 <相对路径>#<帧序号>），未变化的帧跳过，未选中的帧保留原记录
+                for (uint64_t index = 0; index < frame_count; ++index) {
+                    const std::string frame_name = input_name + "#" + frame_index_text(index);
+                    if (!frame_range.contains(index)) {
+                        manifest.keep(frame_name);
+                        continue;
+                    }
+                    if (!force && manifest.unchanged(frame_name, file_size, mtime_ns, output_dir)) {
+                        files_skipped++;
+                        continue;
+                    }
+                    manifest.track(frame_id + file_info.frames.size(), frame_name, file_size, mtime_ns);
+                    file_info.frames.push_back(index);
+                }
+                if (file_info.frames.empty()) {
+                    continue;
+                }
+            } else {
+                // 大小和修改时间与清单一致且输出仍在：跳过，不读取文件
+                if (!force && manifest.unchanged(input_name, file_size, mtime_ns, output_dir)) {
+                    files_skipped++;
+                    continue;
+                }
+                manifest.track(frame_id, input_name, file_size, mtime_ns);
             }
             
-            // 记录内存使用量
-            get_current_memory_usage();
+            const std::string output_subdir = relative_path.parent_path().generic_string();
+            if (use_manifest && !output_subdir.empty() && output_subdirs.insert(output_subdir).second) {
+                std::error_code ec;
+                fs::create_directories(output_dir / output_subdir, ec);
+            }
             
-            files_total++;
+            // 放入文件队列（仅元数据），按元数据的大小占用预算
+            files_total += static_cast<int>(file_info.frameCount());
+            file_info.budget = budget.acquireMetadata(sizeof(FileInfo) + file_info.path.native().size() +
+                                                      file_info.output_name.size() +
+                                                      file_info.frames.size() * sizeof(uint64_t));
+            {
+                TRACE_SCOPE(queue, "PushToFileQueue");
+                TRACE_ASYNC_BEGIN(queue, "InFileQueue", frame_id);
+                file_queue.push(std::move(file_info));
+            }
         }
     }
-    TRACE_INSTANT("MainThreadEnd");
+    TRACE_INSTANT(pipeline, "MainThreadEnd");
     
     // 通知文件读取线程结束
-    file_queue.setDone();
+    file_queue.producerDone();
     
     // 等待所有工作线程完成
-    reader_thread.join();
-    converter_thread.join();
-    writer_thread.join();
+    readers.join();
+    converters.join();
+    writers.join();
+    const double elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
     
     // 停止监控线程
     running = false;
     monitor_thread.join();
     
+    fs::path saved_to = output_dir;
+    if (archive_format != ArchiveFormat::None) {
+        std::string error;
+        if (!archive.close(error)) {
+            std::cerr << "Error writing archive: " << archive_path << ": " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        saved_to = archive_path;
+    } else if (use_manifest && !manifest.save(manifest_path)) {
+        std::cerr << "Error writing manifest: " << manifest_path << std::endl;
+    }
+    
     // 保存 trace 文件
-    fs::path trace_file = dir_path / "conversion_trace.json";
-    TRACE_SAVE(trace_file);
+    if (TRACE_ENABLED()) {
+        fs::path trace_file = dir_path / "conversion_trace.json";
+        TRACE_SAVE_ASYNC(trace_file);
+    }
     
     std::cout << "\nConversion completed. " << files_processed << "/" << files_total
-              << " files processed. PNGs saved to: " << output_dir << std::endl;    
+              << " frames processed (" << files_skipped << " unchanged skipped, " << files_deduplicated
+              << " deduplicated). Output saved to: " << saved_to << std::endl;
+    if (stream_input) {
+        // 包含转换和写入，持续低于输入帧率时说明流水线跟不上实时输入
+        const double frame_mb = static_cast<double>(stream_width) * stream_height * 3 / 2 / (1 << 20);
+        std::printf("Input stream: %llu frames (%.1f MB) in %.2f s, %.1f fps\n",
+                    static_cast<unsigned long long>(stream_frames_read), stream_frames_read * frame_mb, elapsed_seconds,
+                    elapsed_seconds > 0 ? stream_frames_read / elapsed_seconds : 0.0);
+    }
+    if (max_memory) {
+        std::cout << "Memory budget peak: " << (budget.peak() >> 10) << "/" << (max_memory >> 10) << " KB" << std::endl;
+    }
+    
+    // 各阶段时间为所有线程之和：busy 为处理时间，idle 为等上游数据，blocked 为等下游队列、缓冲区或预算
+    if (!stats_path.empty()) {
+        std::FILE* stats = std::fopen(stats_path.string().c_str(), "w");
+        if (!stats) {
+            std::cerr << "Error writing stats: " << stats_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        const double input_mb = static_cast<double>(input_bytes) / (1 << 20);
+        std::fprintf(stats, "{\n");
+        std::fprintf(stats, "  \"frames\": %d,\n", files_processed.load());
+        std::fprintf(stats, "  \"frames_skipped\": %d,\n", files_skipped.load());
+        std::fprintf(stats, "  \"frames_deduplicated\": %d,\n", files_deduplicated.load());
+        std::fprintf(stats, "  \"input_bytes\": %llu,\n", static_cast<unsigned long long>(input_bytes));
+        std::fprintf(stats, "  \"elapsed_s\": %.6f,\n", elapsed_seconds);
+        std::fprintf(stats, "  \"frames_per_s\": %.3f,\n", elapsed_seconds > 0 ? files_processed / elapsed_seconds : 0.0);
+        std::fprintf(stats, "  \"input_mb_per_s\": %.3f,\n", elapsed_seconds > 0 ? input_mb / elapsed_seconds : 0.0);
+        std::fprintf(stats, "  \"peak_rss_kb\": %zu,\n", get_peak_memory_usage());
+        std::fprintf(stats, "  \"budget_peak_bytes\": %zu,\n", budget.peak());
+        const std::pair<const char*, const WorkerPool*> stages[] = {
+            {"reader", &readers}, {"converter", &converters}, {"writer", &writers}};
+        for (size_t i = 0; i < 3; ++i) {
+            const WorkerPool::Times times = stages[i].second->times();
+            std::fprintf(stats, "  \"%s_threads\": %zu,\n", stages[i].first, stages[i].second->size());
+            std::fprintf(stats, "  \"%s_busy_s\": %.6f,\n", stages[i].first, times.busy);
+            std::fprintf(stats, "  \"%s_idle_s\": %.6f,\n", stages[i].first, times.idle);
+            std::fprintf(stats, "  \"%s_blocked_s\": %.6f%s\n", stages[i].first, times.blocked, i + 1 < 3 ? "," : "");
+        }
+        std::fprintf(stats, "}\n");
+        if (std::fclose(stats) != 0) {
+            std::cerr << "Error writing stats: " << stats_path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
     
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,499 @@
+#ifndef CONCURRENT_QUEUE_H
+#define CONCURRENT_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/// 假共享的隔离粒度
+constexpr size_t kCacheLine = 64;
+
+/**
+ * @brief 互斥锁 + 两个条件变量的有界队列，支持多生产者、多消费者
+ *
+ * 原先流水线使用的实现，现在只作为 queue_bench 的对照。
+ */
+template <typename T>
+class LockedQueue {
+public:
+    /**
+     * @param producers 生产者个数，最后一个生产者调用 producerDone 后队列结束
+     * @param capacity 队列容量，满时 push 阻塞
+     */
+    explicit LockedQueue(size_t producers = 1, size_t capacity = 10)
+        : producers_(producers), capacity_(capacity) {}
+
+    void push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (queue_.size() >= capacity_) {
+            cond_producer_.wait(lock);
+        }
+        queue_.push(std::move(item));
+        cond_consumer_.notify_one();
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (queue_.empty() && !done_) {
+            cond_consumer_.wait(lock);
+        }
+        if (queue_.empty() && done_) {
+            return false;
+        }
+        item = std::move(queue_.front());
+        queue_.pop();
+        cond_producer_.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return false;
+        }
+        item = std::move(queue_.front());
+        queue_.pop();
+        cond_producer_.notify_one();
+        return true;
+    }
+
+    void setDone() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        cond_consumer_.notify_all();
+    }
+
+    void producerDone() {
+        if (producers_.fetch_sub(1) == 1) {
+            setDone();
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+private:
+    std::queue<T> queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_consumer_;
+    std::condition_variable cond_producer_;
+    std::atomic<bool> done_{false};
+    std::atomic<size_t> producers_;
+    const size_t capacity_;
+};
+
+/// 忙等一次：x86 上用 pause 降低功耗并让出超线程
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/**
+ * @brief 事件计数：等待方先 prepareWait 取得纪元，再检查条件，条件不满足才 wait
+ *
+ * 通知方先让条件成立再 notify。状态字高 32 位是纪元，低 32 位是尚未被通知的等待者数；
+ * notify 在同一次原子操作中递增纪元并认领等待者，没有等待者时不进入内核，
+ * 连续多次 push 只会为一个正在睡眠的消费者唤醒一次。
+ * Linux 上直接在纪元所在的 32 位字上用 futex 睡眠，其他平台退回互斥锁 + 条件变量。
+ */
+class EventCount {
+public:
+    uint32_t prepareWait() {
+        return epochOf(state_.fetch_add(kWaiter, std::memory_order_seq_cst));
+    }
+
+    /// 条件已满足，不再等待
+    void cancelWait(uint32_t key) {
+        // 纪元已变说明这次等待已被某个 notify 认领，计数不用再减
+        uint64_t state = state_.load(std::memory_order_relaxed);
+        while (epochOf(state) == key && (state & kWaiterMask) != 0 &&
+               !state_.compare_exchange_weak(state, state - kWaiter, std::memory_order_seq_cst)) {
+        }
+    }
+
+    /// 睡眠直到纪元不再等于 key（被通知）
+    void wait(uint32_t key) {
+#if defined(__linux__)
+        while (epochOf(state_.load(std::memory_order_acquire)) == key) {
+            syscall(SYS_futex, epochWord(), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+        }
+#else
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (epochOf(state_.load(std::memory_order_acquire)) == key) {
+            cond_.wait(lock);
+        }
+#endif
+    }
+
+    void notifyOne() { notify(false); }
+    void notifyAll() { notify(true); }
+
+private:
+    static constexpr uint64_t kWaiter = 1;
+    static constexpr uint64_t kWaiterMask = 0xffffffffu;
+    static constexpr uint64_t kEpoch = uint64_t(1) << 32;
+
+    static uint32_t epochOf(uint64_t state) { return static_cast<uint32_t>(state >> 32); }
+
+    uint32_t* epochWord() {
+        // 纪元是状态字的高 32 位
+        return reinterpret_cast<uint32_t*>(&state_) + (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? 1 : 0);
+    }
+
+    void notify(bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t state = state_.load(std::memory_order_seq_cst);
+        uint64_t next;
+        do {
+            if ((state & kWaiterMask) == 0) {
+                return;
+            }
+            next = all ? (state & ~kWaiterMask) + kEpoch : state + kEpoch - kWaiter;
+        } while (!state_.compare_exchange_weak(state, next, std::memory_order_seq_cst));
+#if defined(__linux__)
+        syscall(SYS_futex, epochWord(), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        if (all) {
+            cond_.notify_all();
+        } else {
+            cond_.notify_one();
+        }
+#endif
+    }
+
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "futex needs the plain state word");
+    std::atomic<uint64_t> state_{0};
+#if !defined(__linux__)
+    std::mutex mutex_;
+    std::condition_variable cond_;
+#endif
+};
+
+namespace queue_detail {
+
+inline size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+/// 未构造的 T 存储
+template <typename T>
+struct Storage {
+    alignas(T) unsigned char bytes[sizeof(T)];
+
+    T* get() { return std::launder(reinterpret_cast<T*>(bytes)); }
+};
+
+} // namespace queue_detail
+
+/**
+ * @brief 单生产者单消费者无锁环形队列
+ *
+ * 读写下标各占一个缓存行；每一端缓存对方的下标，只有看起来满 / 空时才重新读取，
+ * 平时一次 push / pop 不会碰到对方写的缓存行。容量向上取整到 2 的幂。
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : mask_(queue_detail::round_up_pow2(capacity ? capacity : 1) - 1),
+          slots_(new queue_detail::Storage<T>[mask_ + 1]) {}
+
+    ~SpscRing() {
+        for (size_t i = head_.load(); i != tail_.load(); ++i) {
+            slots_[i & mask_].get()->~T();
+        }
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    /// 队列满时返回 false，item 保持不变
+    bool tryPush(T&& item) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_) {
+                return false;
+            }
+        }
+        new (slots_[tail & mask_].bytes) T(std::move(item));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
+        }
+        T* slot = slots_[head & mask_].get();
+        item = std::move(*slot);
+        slot->~T();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<queue_detail::Storage<T>[]> slots_;
+    alignas(kCacheLine) std::atomic<size_t> head_{0};  ///< 消费者写
+    size_t tail_cache_ = 0;                             ///< 消费者看到的 tail
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};  ///< 生产者写
+    size_t head_cache_ = 0;                             ///< 生产者看到的 head
+};
+
+/**
+ * @brief 多生产者多消费者无锁环形队列（Vyukov 有界队列）
+ *
+ * 每个槽位带一个序号，生产者 / 消费者各自用 CAS 抢占下标，抢到后只写自己的槽位，
+ * 互相之间只在下标上竞争。容量向上取整到 2 的幂。
+ */
+template <typename T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity)
+        : mask_(queue_detail::round_up_pow2(capacity < 2 ? 2 : capacity) - 1), cells_(new Cell[mask_ + 1]) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcRing() {
+        for (size_t i = dequeue_pos_.load(); i != enqueue_pos_.load(); ++i) {
+            cells_[i & mask_].storage.get()->~T();
+        }
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    /// 队列满时返回 false，item 保持不变
+    bool tryPush(T&& item) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        new (cell->storage.bytes) T(std::move(item));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        T* slot = cell->storage.get();
+        item = std::move(*slot);
+        slot->~T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// 近似值，只用于监控
+    size_t size() const {
+        const size_t dequeued = dequeue_pos_.load(std::memory_order_acquire);
+        const size_t enqueued = enqueue_pos_.load(std::memory_order_acquire);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        queue_detail::Storage<T> storage;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(kCacheLine) std::atomic<size_t> enqueue_pos_{0};
+    alignas(kCacheLine) std::atomic<size_t> dequeue_pos_{0};
+};
+
+/**
+ * @brief 流水线阶段之间的有界阻塞队列
+ *
+ * 只有一个生产者和一个消费者时使用 SpscRing，否则使用 MpmcRing。满 / 空时先忙等一小段时间
+ * （下游通常很快就能腾出位置），仍不行再在 EventCount 上睡眠；单核机器上改为让出 CPU。
+ * 语义与 LockedQueue 相同：最后一个生产者 producerDone（或直接 setDone）后，
+ * 消费者取完剩余数据，pop 返回 false。
+ */
+template <typename T>
+class ConcurrentQueue {
+public:
+    static constexpr size_t kDefaultCapacity = 10;
+
+    /**
+     * @param producers 生产者个数，最后一个生产者调用 producerDone 后队列结束
+     * @param consumers 消费者个数，与 producers 都为 1 时使用单生产者单消费者实现
+     * @param capacity 队列容量（向上取整到 2 的幂），满时 push 阻塞
+     */
+    explicit ConcurrentQueue(size_t producers = 1, size_t consumers = 1, size_t capacity = kDefaultCapacity)
+        : producers_(producers) {
+        if (producers <= 1 && consumers <= 1) {
+            spsc_ = std::make_unique<SpscRing<T>>(capacity);
+        } else {
+            mpmc_ = std::make_unique<MpmcRing<T>>(capacity);
+        }
+    }
+
+    void push(T&& item) {
+        if (!spinUntil([&]() { return tryPushRing(item); })) {
+            while (true) {
+                uint32_t key = not_full_.prepareWait();
+                if (tryPushRing(item)) {
+                    not_full_.cancelWait(key);
+                    break;
+                }
+                not_full_.wait(key);
+            }
+        }
+        not_empty_.notifyOne();
+    }
+
+    bool pop(T& item) {
+        // 先读 done 再取：结束前的 push 都已完成，此时取不到就说明数据已取完
+        bool got = false;
+        auto ready = [&]() {
+            const bool done = done_.load(std::memory_order_acquire);
+            got = tryPop(item);
+            return got || done;
+        };
+        while (!spinUntil(ready)) {
+            uint32_t key = not_empty_.prepareWait();
+            if (ready()) {
+                not_empty_.cancelWait(key);
+                break;
+            }
+            not_empty_.wait(key);
+        }
+        return got;
+    }
+
+    /// 不等待：队列为空时立即返回 false
+    bool tryPop(T& item) {
+        if (!tryPopRing(item)) {
+            return false;
+        }
+        not_full_.notifyOne();
+        return true;
+    }
+
+    /// 结束队列：取完剩余数据后，所有等待中的消费者 pop 返回 false
+    void setDone() {
+        done_.store(true, std::memory_order_release);
+        not_empty_.notifyAll();
+    }
+
+    /// 一个生产者完成；只有最后一个生产者完成时才结束队列
+    void producerDone() {
+        if (producers_.fetch_sub(1) == 1) {
+            setDone();
+        }
+    }
+
+    /// 当前项数，并发修改时为近似值
+    size_t size() const { return spsc_ ? spsc_->size() : mpmc_->size(); }
+
+    size_t capacity() const { return spsc_ ? spsc_->capacity() : mpmc_->capacity(); }
+
+private:
+    static constexpr int kSpinCount = 256;
+    static constexpr int kYieldCount = 2;
+
+    /// 忙等最多 kSpinCount 次直到 fn() 为 true；单核时忙等没有意义，改为让出几次 CPU 给对端
+    template <typename Fn>
+    static bool spinUntil(Fn&& fn) {
+        static const bool single_core = std::thread::hardware_concurrency() <= 1;
+        if (fn()) {
+            return true;
+        }
+        for (int i = 0; i < (single_core ? kYieldCount : kSpinCount); ++i) {
+            if (single_core) {
+                std::this_thread::yield();
+            } else {
+                cpu_relax();
+            }
+            if (fn()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool tryPushRing(T& item) { return spsc_ ? spsc_->tryPush(std::move(item)) : mpmc_->tryPush(std::move(item)); }
+    bool tryPopRing(T& item) { return spsc_ ? spsc_->tryPop(item) : mpmc_->tryPop(item); }
+
+    std::unique_ptr<SpscRing<T>> spsc_;
+    std::unique_ptr<MpmcRing<T>> mpmc_;
+    EventCount not_empty_;
+    EventCount not_full_;
+    std::atomic<bool> done_{false};
+    std::atomic<size_t> producers_;
+};
+
+#endif // CONCURRENT_QUEUE_H
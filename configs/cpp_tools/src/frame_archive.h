@@ -0,0 +1,440 @@
+#ifndef FRAME_ARCHIVE_H
+#define FRAME_ARCHIVE_H
+
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/// 归档输出格式
+enum class ArchiveFormat {
+    None,   ///< 每帧一个文件
+    Tar,    ///< POSIX ustar，可直接用 tar 解开
+    Pack,   ///< 帧数据连续存放，末尾附偏移表，可按名字随机读取
+};
+
+inline const char* archive_extension(ArchiveFormat format) {
+    return format == ArchiveFormat::Tar ? ".tar" : format == ArchiveFormat::Pack ? ".pack" : "";
+}
+
+/// 解析 tar|pack
+inline bool parse_archive_format(const std::string& name, ArchiveFormat& format) {
+    if (name == "tar" || name == "pack") {
+        format = name == "tar" ? ArchiveFormat::Tar : ArchiveFormat::Pack;
+        return true;
+    }
+    return false;
+}
+
+/// 归档的 fsync 策略
+struct ArchiveSync {
+    enum Mode { None, Close, Every } mode = None;
+    size_t every = 0;       ///< Every 模式下每写入多少帧 fsync 一次（关闭时也会 fsync）
+};
+
+/// 解析 none|close|<N>
+inline bool parse_archive_sync(const std::string& text, ArchiveSync& sync) {
+    if (text == "none" || text == "close") {
+        sync.mode = text == "none" ? ArchiveSync::None : ArchiveSync::Close;
+        return true;
+    }
+    char* end = nullptr;
+    unsigned long long every = std::strtoull(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || every == 0 || text[0] == '-') {
+        return false;
+    }
+    sync.mode = ArchiveSync::Every;
+    sync.every = static_cast<size_t>(every);
+    return true;
+}
+
+namespace archive_detail {
+
+constexpr size_t kTarBlock = 512;
+constexpr char kPackMagic[8] = {'N', 'V', 'P', 'A', 'C', 'K', '\0', '\1'};
+constexpr char kPackIndexMagic[8] = {'N', 'V', 'P', 'K', 'I', 'D', 'X', '\0'};
+constexpr size_t kPackFooterSize = 24;     ///< 索引偏移 u64 + 条目数 u64 + kPackIndexMagic
+
+inline void put_le(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+inline uint64_t get_le(const uint8_t* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+/// 写 ustar 数字字段：八进制、补零、以 NUL 结尾
+inline bool put_octal(char* field, size_t width, uint64_t value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%0*llo", static_cast<int>(width - 1), static_cast<unsigned long long>(value));
+    if (std::strlen(text) != width - 1) {
+        return false;
+    }
+    std::memcpy(field, text, width);
+    return true;
+}
+
+inline uint64_t get_octal(const char* field, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = value * 8 + static_cast<uint64_t>(field[i] - '0');
+    }
+    return value;
+}
+
+/// 生成一个 ustar 头部块；name 超过 100 字节时由调用方先写 PAX 头
+inline bool tar_header(uint8_t* block, const std::string& name, uint64_t size, int64_t mtime, char type) {
+    std::memset(block, 0, kTarBlock);
+    char* h = reinterpret_cast<char*>(block);
+    std::memcpy(h, name.data(), std::min<size_t>(name.size(), 100));
+    put_octal(h + 100, 8, 0644);
+    put_octal(h + 108, 8, 0);
+    put_octal(h + 116, 8, 0);
+    if (!put_octal(h + 124, 12, size)) {
+        return false;
+    }
+    put_octal(h + 136, 12, static_cast<uint64_t>(mtime > 0 ? mtime : 0));
+    h[156] = type;
+    std::memcpy(h + 257, "ustar", 6);
+    std::memcpy(h + 263, "00", 2);
+    // 校验和按校验和字段为空格计算
+    std::memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < kTarBlock; ++i) {
+        sum += block[i];
+    }
+    std::snprintf(h + 148, 8, "%06o", sum);
+    h[155] = ' ';
+    return true;
+}
+
+/// PAX 扩展头中的一条记录 "<长度> path=<name>\n"，长度包含自身的位数
+inline std::string pax_path_record(const std::string& name) {
+    const std::string body = " path=" + name + "\n";
+    size_t length = body.size() + 1;
+    while (std::to_string(length).size() + body.size() != length) {
+        ++length;
+    }
+    return std::to_string(length) + body;
+}
+
+} // namespace archive_detail
+
+/**
+ * @brief 把编码好的帧追加到一个归档文件，代替每帧一个输出文件
+ *
+ * 网络文件系统和 overlayfs 上逐个创建小文件的元数据开销远大于写入本身；
+ * 归档只打开一个文件，帧先拷进内存缓冲区，攒够 buffer_bytes 后一次顺序写出。
+ * append 可在多个写入线程中并发调用，条目顺序即调用顺序。
+ * 写到临时文件名，close 成功后才改名为最终路径，中途失败不会留下看似完整的归档。
+ */
+class ArchiveWriter {
+public:
+    static constexpr size_t kDefaultBufferBytes = 8 << 20;
+
+    ArchiveWriter(ArchiveFormat format, ArchiveSync sync, size_t buffer_bytes = kDefaultBufferBytes)
+        : format_(format), sync_(sync), buffer_bytes_(buffer_bytes) {}
+
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    ~ArchiveWriter() {
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    /// 创建 path 的临时文件并写入文件头
+    bool open(const std::filesystem::path& path, std::string& error) {
+        path_ = path;
+        partial_ = path;
+        partial_ += ".partial";
+        file_ = std::fopen(partial_.string().c_str(), "wb");
+        if (!file_) {
+            error = std::strerror(errno);
+            return false;
+        }
+        // 缓冲由本类管理，stdio 不再二次拷贝
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        buffer_.reserve(buffer_bytes_);
+        if (format_ == ArchiveFormat::Pack) {
+            buffer_.insert(buffer_.end(), archive_detail::kPackMagic, archive_detail::kPackMagic + 8);
+        }
+        return true;
+    }
+
+    /// 追加一个条目，线程安全
+    bool append(const std::string& name, const uint8_t* data, size_t size, int64_t mtime, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok_) {
+            error = error_;
+            return false;
+        }
+        if (format_ == ArchiveFormat::Tar) {
+            uint8_t header[archive_detail::kTarBlock];
+            if (!archive_detail::tar_header(header, name, size, mtime, '0')) {
+                error = "entry too large for tar: " + name;
+                return false;
+            }
+            if (name.size() > 100) {
+                // 长名字放在前面的 PAX 扩展头里
+                uint8_t pax[archive_detail::kTarBlock];
+                const std::string record = archive_detail::pax_path_record(name);
+                archive_detail::tar_header(pax, "PaxHeader", record.size(), mtime, 'x');
+                write(pax, sizeof(pax));
+                write(reinterpret_cast<const uint8_t*>(record.data()), record.size());
+                pad();
+            }
+            write(header, sizeof(header));
+            write(data, size);
+            pad();
+        } else {
+            index_.push_back({name, offset_ + buffer_.size(), size, mtime});
+            write(data, size);
+        }
+        ++entries_;
+        if (sync_.mode == ArchiveSync::Every && entries_ % sync_.every == 0) {
+            flush(true);
+        }
+        if (!ok_) {
+            error = error_;
+        }
+        return ok_;
+    }
+
+    /// 写入结尾（tar 的两个空块或 pack 的索引），按策略 fsync，然后改为最终文件名
+    bool close(std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) {
+            error = "archive is not open";
+            return false;
+        }
+        if (format_ == ArchiveFormat::Tar) {
+            buffer_.insert(buffer_.end(), 2 * archive_detail::kTarBlock, 0);
+        } else {
+            const uint64_t index_offset = offset_ + buffer_.size();
+            for (const Entry& entry : index_) {
+                archive_detail::put_le(buffer_, entry.offset, 8);
+                archive_detail::put_le(buffer_, entry.size, 8);
+                archive_detail::put_le(buffer_, static_cast<uint64_t>(entry.mtime), 8);
+                archive_detail::put_le(buffer_, entry.name.size(), 4);
+                buffer_.insert(buffer_.end(), entry.name.begin(), entry.name.end());
+            }
+            archive_detail::put_le(buffer_, index_offset, 8);
+            archive_detail::put_le(buffer_, index_.size(), 8);
+            buffer_.insert(buffer_.end(), archive_detail::kPackIndexMagic, archive_detail::kPackIndexMagic + 8);
+        }
+        flush(sync_.mode != ArchiveSync::None);
+        if (std::fclose(file_) != 0 && ok_) {
+            fail(std::strerror(errno));
+        }
+        file_ = nullptr;
+        if (ok_) {
+            std::error_code ec;
+            std::filesystem::rename(partial_, path_, ec);
+            if (ec) {
+                fail(ec.message());
+            }
+        }
+        if (!ok_) {
+            error = error_;
+        }
+        return ok_;
+    }
+
+    size_t entries() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_;
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        uint64_t offset;
+        uint64_t size;
+        int64_t mtime;
+    };
+
+    void fail(const std::string& message) {
+        if (ok_) {
+            ok_ = false;
+            error_ = message;
+        }
+    }
+
+    void write(const uint8_t* data, size_t size) {
+        // 超过缓冲区的大条目先写出已缓冲的内容，再直接写出，不经过缓冲区
+        if (buffer_.size() + size > buffer_bytes_) {
+            flush(false);
+            if (size >= buffer_bytes_) {
+                writeFile(data, size);
+                return;
+            }
+        }
+        buffer_.insert(buffer_.end(), data, data + size);
+    }
+
+    /// tar 条目数据补齐到 512 字节
+    void pad() {
+        const uint64_t used = (offset_ + buffer_.size()) % archive_detail::kTarBlock;
+        if (used) {
+            buffer_.insert(buffer_.end(), archive_detail::kTarBlock - used, 0);
+        }
+    }
+
+    void flush(bool sync) {
+        writeFile(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        if (sync && ok_) {
+#if defined(_WIN32)
+            const int rc = _commit(_fileno(file_));
+#else
+            const int rc = fsync(fileno(file_));
+#endif
+            if (rc != 0) {
+                fail(std::string("fsync: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    void writeFile(const uint8_t* data, size_t size) {
+        if (ok_ && size > 0 && std::fwrite(data, 1, size, file_) != size) {
+            fail(std::strerror(errno));
+        }
+        offset_ += size;
+    }
+
+    const ArchiveFormat format_;
+    const ArchiveSync sync_;
+    const size_t buffer_bytes_;
+    mutable std::mutex mutex_;
+    std::FILE* file_ = nullptr;
+    std::filesystem::path path_;
+    std::filesystem::path partial_;
+    std::vector<uint8_t> buffer_;
+    uint64_t offset_ = 0;       ///< 已写出到文件的字节数
+    std::vector<Entry> index_;  ///< pack 格式的偏移表
+    size_t entries_ = 0;
+    bool ok_ = true;
+    std::string error_;         ///< 第一次失败的原因，之后的 append 都返回它
+};
+
+/// 归档中的一个条目
+struct ArchiveEntry {
+    std::string name;
+    uint64_t offset = 0;    ///< 数据在归档文件中的偏移
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+/**
+ * @brief 读取 tar 或 pack 归档的目录（格式按文件头识别）
+ *
+ * tar 顺序扫描各条目头部并跳过数据；pack 只读取末尾的偏移表。
+ */
+inline bool read_archive_index(std::istream& in, std::vector<ArchiveEntry>& entries, ArchiveFormat& format,
+                               std::string& error) {
+    using namespace archive_detail;
+    entries.clear();
+    char magic[8] = {};
+    in.seekg(0);
+    in.read(magic, sizeof(magic));
+    if (in.gcount() == sizeof(magic) && std::memcmp(magic, kPackMagic, sizeof(magic)) == 0) {
+        format = ArchiveFormat::Pack;
+        uint8_t footer[kPackFooterSize];
+        in.seekg(-static_cast<std::streamoff>(kPackFooterSize), std::ios::end);
+        if (!in.read(reinterpret_cast<char*>(footer), sizeof(footer)) ||
+            std::memcmp(footer + 16, kPackIndexMagic, sizeof(kPackIndexMagic)) != 0) {
+            error = "missing pack index (archive was not closed)";
+            return false;
+        }
+        const uint64_t count = get_le(footer + 8, 8);
+        in.seekg(static_cast<std::streamoff>(get_le(footer, 8)));
+        for (uint64_t i = 0; i < count; ++i) {
+            uint8_t fixed[28];
+            ArchiveEntry entry;
+            if (!in.read(reinterpret_cast<char*>(fixed), sizeof(fixed))) {
+                error = "truncated pack index";
+                return false;
+            }
+            entry.offset = get_le(fixed, 8);
+            entry.size = get_le(fixed + 8, 8);
+            entry.mtime = static_cast<int64_t>(get_le(fixed + 16, 8));
+            entry.name.resize(static_cast<size_t>(get_le(fixed + 24, 4)));
+            if (!in.read(entry.name.data(), static_cast<std::streamsize>(entry.name.size()))) {
+                error = "truncated pack index";
+                return false;
+            }
+            entries.push_back(std::move(entry));
+        }
+        return true;
+    }
+
+    format = ArchiveFormat::Tar;
+    in.clear();
+    in.seekg(0);
+    std::string long_name;      // 上一个 PAX 头给出的下一个条目的名字
+    char block[kTarBlock];
+    uint64_t offset = 0;
+    while (in.read(block, sizeof(block))) {
+        offset += kTarBlock;
+        if (block[0] == '\0') {
+            return true;        // 结尾的空块
+        }
+        if (std::memcmp(block + 257, "ustar", 5) != 0) {
+            error = "not a tar or pack archive";
+            return false;
+        }
+        const uint64_t size = get_octal(block + 124, 12);
+        const char type = block[156];
+        if (type == 'x') {
+            std::string records(static_cast<size_t>(size), '\0');
+            if (!in.read(records.data(), static_cast<std::streamsize>(size))) {
+                break;
+            }
+            const size_t key = records.find(" path=");
+            if (key != std::string::npos) {
+                const size_t end = records.find('\n', key);
+                long_name = records.substr(key + 6, end == std::string::npos ? std::string::npos : end - key - 6);
+            }
+        } else if (type == '0' || type == '\0') {
+            ArchiveEntry entry;
+            if (!long_name.empty()) {
+                entry.name = std::move(long_name);
+                long_name.clear();
+            } else {
+                const std::string prefix(block + 345, strnlen(block + 345, 155));
+                entry.name = (prefix.empty() ? "" : prefix + "/") + std::string(block, strnlen(block, 100));
+            }
+            entry.offset = offset;
+            entry.size = size;
+            entry.mtime = static_cast<int64_t>(get_octal(block + 136, 12));
+            entries.push_back(std::move(entry));
+        }
+        offset += (size + kTarBlock - 1) / kTarBlock * kTarBlock;
+        in.seekg(static_cast<std::streamoff>(offset));
+    }
+    error = "truncated tar archive";
+    return false;
+}
+
+#endif // FRAME_ARCHIVE_H
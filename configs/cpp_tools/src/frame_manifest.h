@@ -0,0 +1,283 @@
+#ifndef FRAME_MANIFEST_H
+#define FRAME_MANIFEST_H
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * @brief XXH64 哈希（与参考实现输出一致），用作帧内容哈希
+ *
+ * 单线程可达数 GB/s，相对颜色转换和 PNG 编码可以忽略。
+ */
+inline uint64_t xxh64(const void* input, size_t length, uint64_t seed = 0) {
+    constexpr uint64_t P1 = 11400714785074694791ULL;
+    constexpr uint64_t P2 = 14029467366897019727ULL;
+    constexpr uint64_t P3 = 1609587929392839161ULL;
+    constexpr uint64_t P4 = 9650029242287828579ULL;
+    constexpr uint64_t P5 = 2870177450012600261ULL;
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return v; };
+    auto read32 = [](const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; };
+    auto round = [&](uint64_t acc, uint64_t lane) { return rotl(acc + lane * P2, 31) * P1; };
+    auto merge = [&](uint64_t acc, uint64_t v) { return (acc ^ round(0, v)) * P1 + P4; };
+
+    const uint8_t* p = static_cast<const uint8_t*>(input);
+    const uint8_t* end = p + length;
+    uint64_t h;
+    if (length >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(h, v1);
+        h = merge(h, v2);
+        h = merge(h, v3);
+        h = merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += static_cast<uint64_t>(length);
+    for (; p + 8 <= end; p += 8) {
+        h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h = rotl(h ^ (*p * P5), 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/// 帧内容哈希：分辨率作为种子，字节相同但分辨率不同的帧不会被当作重复
+inline uint64_t frame_hash(const uint8_t* data, size_t size, int width, int height) {
+    return xxh64(data, size, (static_cast<uint64_t>(width) << 32) | static_cast<uint32_t>(height));
+}
+
+/// 清单中一个输入文件的记录
+struct ManifestEntry {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    uint64_t hash = 0;
+    std::string output;     ///< 输出目录中的文件名
+};
+
+/**
+ * @brief 输出目录中的转换清单，记录每个输入的大小、修改时间、内容哈希和对应的输出文件
+ *
+ * 重新运行时，大小和修改时间都没变且输出文件仍在的输入在扫描阶段直接跳过，不再读取；
+ * 其余输入照常转换，转换前按内容哈希查找已有的相同帧输出，找到则直接复用。
+ * 清单记录生成输出时的编码设置，设置变化后旧记录全部作废。
+ * 只有写入成功的输出才会记入新清单，中途失败的帧下次会重新转换。
+ *
+ * 文件格式为制表符分隔的文本，第一行为设置：
+ *   settings<TAB><设置>
+ *   <大小><TAB><修改时间 ns><TAB><哈希 hex><TAB><输入相对路径><TAB><输出相对路径>
+ */
+class FrameManifest {
+public:
+    static constexpr const char* kFileName = "manifest.tsv";
+
+    /// @param settings 影响输出内容的编码设置
+    explicit FrameManifest(std::string settings) : settings_(std::move(settings)) {}
+
+    /**
+     * @brief 读取上次运行的清单
+     * @return 清单不存在、无法解析或设置不同时返回 false，此时所有输入都会重新转换
+     */
+    bool load(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        std::string line;
+        if (!file || !std::getline(file, line) || line != "settings\t" + settings_) {
+            return false;
+        }
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            ManifestEntry entry;
+            std::string hash, input;
+            if (!(fields >> entry.size >> entry.mtime_ns >> hash) || fields.get() != '\t' ||
+                !std::getline(fields, input, '\t') || !std::getline(fields, entry.output) || entry.output.empty()) {
+                continue;
+            }
+            char* end = nullptr;
+            entry.hash = std::strtoull(hash.c_str(), &end, 16);
+            if (*end != '\0') {
+                continue;
+            }
+            by_hash_.emplace(entry.hash, entry.output);
+            previous_.emplace(std::move(input), std::move(entry));
+        }
+        return true;
+    }
+
+    /// 写出本次运行的清单（先写临时文件再改名）
+    bool save(const std::filesystem::path& path) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::filesystem::path temp = path;
+        temp += ".tmp";
+        {
+            std::ofstream file(temp, std::ios::trunc);
+            file << "settings\t" << settings_ << '\n';
+            for (const auto& [input, entry] : current_) {
+                file << entry.size << '\t' << entry.mtime_ns << '\t' << std::hex << entry.hash << std::dec << '\t'
+                     << input << '\t' << entry.output << '\n';
+            }
+            if (!file.flush()) {
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp, path, ec);
+        return !ec;
+    }
+
+    /**
+     * @brief 扫描阶段调用：输入与上次相同且输出仍存在时返回 true，并保留旧记录
+     */
+    bool unchanged(const std::string& input, uint64_t size, int64_t mtime_ns,
+                   const std::filesystem::path& output_dir) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = previous_.find(input);
+        if (it == previous_.end() || it->second.size != size || it->second.mtime_ns != mtime_ns) {
+            return false;
+        }
+        std::error_code ec;
+        if (!std::filesystem::exists(output_dir / it->second.output, ec)) {
+            return false;
+        }
+        current_[input] = it->second;
+        return true;
+    }
+
+    /// 本次运行没有选中的输入（例如 --frames 之外的帧）：原样保留上次的记录
+    void keep(const std::string& input) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = previous_.find(input);
+        if (it != previous_.end()) {
+            current_[input] = it->second;
+        }
+    }
+
+    /// 记录一个待转换的输入，frame_id 用于后续阶段关联
+    void track(uint64_t frame_id, const std::string& input, uint64_t size, int64_t mtime_ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Pending& pending = pending_[frame_id];
+        // 输入已变化，它的旧输出可能被覆盖，不能再供其他帧复用；只有内容确实没变时才保留给自己
+        auto previous = previous_.find(input);
+        if (previous != previous_.end()) {
+            pending.previous = previous->second;
+            auto it = by_hash_.find(previous->second.hash);
+            if (it != by_hash_.end() && it->second == previous->second.output) {
+                by_hash_.erase(it);
+            }
+        }
+        pending.input = input;
+        pending.entry.size = size;
+        pending.entry.mtime_ns = mtime_ns;
+    }
+
+    /**
+     * @brief 转换阶段调用：记录内容哈希，已有相同内容的输出时通过 existing 返回其文件名
+     *
+     * 只是修改时间变化而内容不变的输入返回它自己原来的输出。
+     */
+    bool findDuplicate(uint64_t frame_id, uint64_t hash, const std::filesystem::path& output_dir,
+                       std::string& existing) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::error_code ec;
+        auto pending = pending_.find(frame_id);
+        if (pending != pending_.end()) {
+            pending->second.entry.hash = hash;
+            const ManifestEntry& previous = pending->second.previous;
+            if (!previous.output.empty() && previous.hash == hash &&
+                std::filesystem::exists(output_dir / previous.output, ec)) {
+                existing = previous.output;
+                return true;
+            }
+        }
+        auto it = by_hash_.find(hash);
+        if (it == by_hash_.end() || !std::filesystem::exists(output_dir / it->second, ec)) {
+            return false;
+        }
+        existing = it->second;
+        return true;
+    }
+
+    /// 输出写入成功后调用
+    void commit(uint64_t frame_id, const std::string& output) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(frame_id);
+        if (it == pending_.end()) {
+            return;
+        }
+        it->second.entry.output = output;
+        by_hash_[it->second.entry.hash] = output;
+        current_[it->second.input] = std::move(it->second.entry);
+        pending_.erase(it);
+    }
+
+private:
+    struct Pending {
+        std::string input;
+        ManifestEntry entry;
+        ManifestEntry previous;     ///< 上次运行的记录，没有时 output 为空
+    };
+
+    mutable std::mutex mutex_;
+    std::string settings_;
+    std::unordered_map<std::string, ManifestEntry> previous_;   ///< 上次运行的记录
+    std::map<std::string, ManifestEntry> current_;              ///< 本次运行的记录，按输入名排序写出
+    std::unordered_map<uint64_t, Pending> pending_;             ///< frame_id -> 转换中的输入
+    std::unordered_map<uint64_t, std::string> by_hash_;         ///< 内容哈希 -> 已有输出
+};
+
+/// 输出的临时文件名，写完后改名为 path；保留扩展名以便编码器识别格式
+inline std::filesystem::path partial_output_path(const std::filesystem::path& path) {
+    return path.parent_path() / (path.stem().string() + ".partial" + path.extension().string());
+}
+
+/**
+ * @brief 用已有的输出文件作为 to：优先硬链接，跨文件系统等情况下退回复制
+ *
+ * 先在临时文件名上创建再改名，to 原本与其他输出共用 inode 时也不会改动其他输出。
+ */
+inline bool reuse_output(const std::filesystem::path& from, const std::filesystem::path& to, std::string& error) {
+    namespace fs = std::filesystem;
+    fs::path temp = partial_output_path(to);
+    std::error_code ec;
+    fs::remove(temp, ec);
+    fs::create_hard_link(from, temp, ec);
+    if (ec) {
+        ec.clear();
+        fs::copy_file(from, temp, fs::copy_options::overwrite_existing, ec);
+    }
+    if (!ec) {
+        fs::rename(temp, to, ec);
+    }
+    if (ec) {
+        error = ec.message();
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+#endif // FRAME_MANIFEST_H
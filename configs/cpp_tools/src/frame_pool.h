@@ -0,0 +1,246 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <vector>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "systrace.h"
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+class FramePool;
+
+/**
+ * @brief 从 FramePool 借出的帧缓冲区，析构时自动归还
+ *
+ * 只能移动不能拷贝，可以放进队列在流水线各阶段之间传递。
+ */
+class FrameBuffer {
+public:
+    FrameBuffer() = default;
+
+    FrameBuffer(FrameBuffer&& other) noexcept
+        : pool_(other.pool_), data_(other.data_), size_(other.size_) {
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    FrameBuffer& operator=(FrameBuffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            pool_ = other.pool_;
+            data_ = other.data_;
+            size_ = other.size_;
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    FrameBuffer(const FrameBuffer&) = delete;
+    FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+    ~FrameBuffer() {
+        reset();
+    }
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+    /// 提前归还缓冲区
+    inline void reset();
+
+private:
+    friend class FramePool;
+
+    FrameBuffer(FramePool* pool, uint8_t* data, size_t size) : pool_(pool), data_(data), size_(size) {}
+
+    FramePool* pool_ = nullptr;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief 按帧大小（由分辨率和像素格式决定）复用的页对齐帧缓冲区池
+ *
+ * 池中缓冲区总数不超过 max_buffers、总字节数不超过 max_bytes（为 0 时不限）：
+ * 全部借出时 acquire 阻塞，直到下游阶段归还，因此池的大小也就是流水线中同时在途的帧数上限。
+ * 需要新尺寸而池已满时，优先释放其他尺寸的空闲缓冲区；没有借出的缓冲区时总是允许分配，
+ * 单帧超过 max_bytes 也不会卡死。新分配的缓冲区会预先写零，缺页只发生一次。
+ */
+class FramePool {
+public:
+    static constexpr size_t kPageSize = 4096;
+
+    explicit FramePool(size_t max_buffers, size_t max_bytes = 0)
+        : max_buffers_(max_buffers ? max_buffers : 1), max_bytes_(max_bytes) {}
+
+    ~FramePool() {
+        for (auto& [size, buffers] : free_) {
+            for (uint8_t* data : buffers) {
+                deallocate(data);
+            }
+        }
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /**
+     * @brief 借出一个至少 bytes 字节的缓冲区，池已满时阻塞等待归还
+     * @throws std::bad_alloc 分配失败
+     */
+    FrameBuffer acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint8_t* data = nullptr;
+        while (!(data = take(lock, bytes))) {
+            TRACE_SCOPE(queue, "WaitForFrameBuffer");
+            cond_.wait(lock);
+        }
+        return FrameBuffer(this, data, bytes);
+    }
+
+    /**
+     * @brief 不阻塞地借出缓冲区，池已满且没有可用缓冲区时返回 false
+     *
+     * 同时持有多个借出缓冲区的调用方（例如批量异步读取）应使用此接口，
+     * 避免在自己持有的缓冲区上等待而死锁。
+     * @throws std::bad_alloc 分配失败
+     */
+    bool tryAcquire(size_t bytes, FrameBuffer& buffer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint8_t* data = take(lock, bytes);
+        lock.unlock();
+        if (!data) {
+            return false;
+        }
+        buffer = FrameBuffer(this, data, bytes);
+        return true;
+    }
+
+    /// 当前借出的缓冲区数
+    size_t inUse() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_use_;
+    }
+
+    size_t capacity() const { return max_buffers_; }
+
+    /// 已分配（借出 + 空闲）的字节数
+    size_t allocatedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocated_bytes_;
+    }
+
+private:
+    friend class FrameBuffer;
+
+    void release(uint8_t* data, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_[bytes].push_back(data);
+        --in_use_;
+        cond_.notify_one();
+    }
+
+    /// 复用或新分配一个缓冲区，池已满时返回 nullptr；分配期间暂时释放锁
+    uint8_t* take(std::unique_lock<std::mutex>& lock, size_t bytes) {
+        while (true) {
+            auto it = free_.find(bytes);
+            if (it != free_.end() && !it->second.empty()) {
+                uint8_t* data = it->second.back();
+                it->second.pop_back();
+                ++in_use_;
+                return data;
+            }
+            const bool fits = allocated_ < max_buffers_ && (max_bytes_ == 0 || allocated_bytes_ + bytes <= max_bytes_);
+            if (!fits && evictOther(bytes)) {
+                continue;
+            }
+            // 没有借出的缓冲区时不会有人归还，只能超额分配
+            if (fits || in_use_ == 0) {
+                ++allocated_;
+                allocated_bytes_ += bytes;
+                ++in_use_;
+                lock.unlock();
+                uint8_t* data = allocate(bytes);
+                lock.lock();
+                if (!data) {
+                    --allocated_;
+                    allocated_bytes_ -= bytes;
+                    --in_use_;
+                    throw std::bad_alloc();
+                }
+                return data;
+            }
+            return nullptr;
+        }
+    }
+
+    /// 释放一个其他尺寸的空闲缓冲区，为新尺寸腾出名额
+    bool evictOther(size_t bytes) {
+        for (auto& [size, buffers] : free_) {
+            if (size != bytes && !buffers.empty()) {
+                deallocate(buffers.back());
+                buffers.pop_back();
+                --allocated_;
+                allocated_bytes_ -= size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint8_t* allocate(size_t bytes) {
+        size_t rounded = (bytes + kPageSize - 1) / kPageSize * kPageSize;
+        void* data = nullptr;
+#if defined(_WIN32)
+        data = _aligned_malloc(rounded, kPageSize);
+#else
+        if (posix_memalign(&data, kPageSize, rounded) != 0) {
+            data = nullptr;
+        }
+#endif
+        if (data) {
+            std::memset(data, 0, rounded);
+        }
+        return static_cast<uint8_t*>(data);
+    }
+
+    static void deallocate(uint8_t* data) {
+#if defined(_WIN32)
+        _aligned_free(data);
+#else
+        std::free(data);
+#endif
+    }
+
+    const size_t max_buffers_;
+    const size_t max_bytes_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::unordered_map<size_t, std::vector<uint8_t*>> free_;   ///< 帧字节数 -> 空闲缓冲区
+    size_t allocated_ = 0;      ///< 已分配（借出 + 空闲）的缓冲区数
+    size_t allocated_bytes_ = 0;
+    size_t in_use_ = 0;
+};
+
+inline void FrameBuffer::reset() {
+    if (pool_) {
+        pool_->release(data_, size_);
+        pool_ = nullptr;
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,571 @@
+#ifndef FRAME_READER_H
+#define FRAME_READER_H
+
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__) || defined(__CYGWIN__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FRAME_READER_POSIX 1
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define FRAME_READER_HAS_URING 1
+#endif
+
+/// 输入后端
+enum class InputBackend {
+    Stream,     ///< 逐帧同步读入缓冲区池（FrameFile）
+    Mmap,       ///< 只读映射文件，直接作为 cv::Mat 的数据
+    Uring,      ///< io_uring 批量异步读入缓冲区池，不可用时退回 pread
+};
+
+inline bool parse_input_backend(const std::string& name, InputBackend& backend) {
+    if (name == "stream") backend = InputBackend::Stream;
+#ifdef FRAME_READER_POSIX
+    else if (name == "mmap") backend = InputBackend::Mmap;
+    else if (name == "uring") backend = InputBackend::Uring;
+#endif
+    else return false;
+    return true;
+}
+
+/**
+ * @brief 按偏移读取帧的文件，多帧文件中的各帧依次读取
+ *
+ * POSIX 上用 pread 并提示内核顺序访问，willNeed 让内核提前读入下一帧；其他平台用 std::ifstream。
+ */
+class FrameFile {
+public:
+    FrameFile() = default;
+    FrameFile(const FrameFile&) = delete;
+    FrameFile& operator=(const FrameFile&) = delete;
+
+    ~FrameFile() {
+#ifdef FRAME_READER_POSIX
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+    }
+
+    bool open(const std::filesystem::path& path) {
+#ifdef FRAME_READER_POSIX
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return true;
+#else
+        file_.open(path, std::ios::binary);
+        return static_cast<bool>(file_);
+#endif
+    }
+
+    /// 读取 offset 处的 size 字节，文件不够长时返回 false
+    bool read(void* buffer, size_t size, uint64_t offset) {
+#ifdef FRAME_READER_POSIX
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(fd_, static_cast<char*>(buffer) + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        return true;
+#else
+        file_.seekg(static_cast<std::streamoff>(offset));
+        return static_cast<bool>(file_.read(static_cast<char*>(buffer), static_cast<std::streamsize>(size)));
+#endif
+    }
+
+    /// 提示内核后台读入 [offset, offset + size)
+    void willNeed([[maybe_unused]] uint64_t offset, [[maybe_unused]] size_t size) {
+#ifdef FRAME_READER_POSIX
+        posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+#endif
+    }
+
+private:
+#ifdef FRAME_READER_POSIX
+    int fd_ = -1;
+#else
+    std::ifstream file_;
+#endif
+};
+
+/**
+ * @brief 顺序读取标准输入、管道或 FIFO 中首尾相接的定长帧
+ *
+ * 每次按整帧大小发起读取，管道每次最多返回缓冲区中已有的数据，循环读满一帧。
+ * Linux 上把管道缓冲区扩大到 kPipeBufferSize，写入方（例如 adb）不必每 64 KB 就等一次。
+ * POSIX 上读取前用 poll 限时等待，cancel 置位后最迟 kPollIntervalMs 毫秒返回；
+ * 其他平台用 std::fread，只在帧之间检查 cancel。
+ */
+class FrameStream {
+public:
+    static constexpr size_t kPipeBufferSize = 1 << 20;
+    static constexpr int kPollIntervalMs = 100;
+
+    explicit FrameStream(const std::atomic<bool>* cancel = nullptr) : cancel_(cancel) {}
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    ~FrameStream() {
+#ifdef FRAME_READER_POSIX
+        if (fd_ > STDIN_FILENO) {
+            ::close(fd_);
+        }
+#else
+        if (file_ && file_ != stdin) {
+            std::fclose(file_);
+        }
+#endif
+    }
+
+    /// 打开 path（FIFO 会等到写入方打开为止）；path 为空时读取标准输入
+    bool open(const std::filesystem::path& path) {
+#ifdef FRAME_READER_POSIX
+        fd_ = path.empty() ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            error_ = std::strerror(errno);
+            return false;
+        }
+#ifdef F_SETPIPE_SZ
+        struct stat st;
+        if (::fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode)) {
+            ::fcntl(fd_, F_SETPIPE_SZ, static_cast<int>(kPipeBufferSize));   // 失败时保持默认大小
+        }
+#endif
+#else
+        file_ = path.empty() ? stdin : std::fopen(path.string().c_str(), "rb");
+        if (!file_) {
+            error_ = std::strerror(errno);
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    /// 读满 size 字节，返回实际读到的字节数；到达末尾、出错或被取消时少于 size
+    size_t read(void* buffer, size_t size) {
+        char* data = static_cast<char*>(buffer);
+        size_t done = 0;
+#ifdef FRAME_READER_POSIX
+        while (done < size && !cancelled()) {
+            pollfd pfd{fd_, POLLIN, 0};
+            const int ready = ::poll(&pfd, 1, kPollIntervalMs);
+            if (ready == 0 || (ready < 0 && errno == EINTR)) {
+                continue;
+            }
+            const ssize_t n = ::read(fd_, data + done, size - done);
+            if (n > 0) {
+                done += static_cast<size_t>(n);
+            } else if (n == 0) {
+                break;
+            } else if (errno != EINTR && errno != EAGAIN) {
+                error_ = std::strerror(errno);
+                break;
+            }
+        }
+#else
+        if (!cancelled()) {
+            done = std::fread(data, 1, size, file_);
+            if (done < size && std::ferror(file_)) {
+                error_ = std::strerror(errno);
+            }
+        }
+#endif
+        return done;
+    }
+
+    bool cancelled() const { return cancel_ && cancel_->load(std::memory_order_relaxed); }
+
+    /// 最近一次打开或读取失败的原因，没有出错时为空
+    const std::string& error() const { return error_; }
+
+private:
+    const std::atomic<bool>* cancel_;
+    std::string error_;
+#ifdef FRAME_READER_POSIX
+    int fd_ = -1;
+#else
+    std::FILE* file_ = nullptr;
+#endif
+};
+
+#ifdef FRAME_READER_POSIX
+
+/**
+ * @brief 只读映射的一帧文件，析构时解除映射
+ *
+ * 映射后提示内核顺序访问并预读，转换线程直接在映射上做颜色转换，省去一次整帧拷贝。
+ */
+class MappedFrame {
+public:
+    MappedFrame() = default;
+
+    MappedFrame(MappedFrame&& other) noexcept
+        : base_(other.base_), map_size_(other.map_size_), data_(other.data_), size_(other.size_) {
+        other.base_ = nullptr;
+        other.map_size_ = 0;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    MappedFrame& operator=(MappedFrame&& other) noexcept {
+        if (this != &other) {
+            reset();
+            base_ = other.base_;
+            map_size_ = other.map_size_;
+            data_ = other.data_;
+            size_ = other.size_;
+            other.base_ = nullptr;
+            other.map_size_ = 0;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    MappedFrame(const MappedFrame&) = delete;
+    MappedFrame& operator=(const MappedFrame&) = delete;
+
+    ~MappedFrame() {
+        reset();
+    }
+
+    /**
+     * @brief 映射文件中从 offset 开始的 size 字节
+     * @param error 失败原因
+     * @return 打开或映射失败、或文件短于 offset + size 时返回 false
+     */
+    bool open(const std::filesystem::path& path, size_t size, std::string& error, uint64_t offset = 0) {
+        reset();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < offset + size) {
+            error = "file is shorter than one frame";
+            ::close(fd);
+            return false;
+        }
+        // mmap 的偏移必须按页对齐，多帧文件中的帧一般不在页边界上
+        const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const uint64_t aligned = offset / page * page;
+        const size_t map_size = size + static_cast<size_t>(offset - aligned);
+        void* base = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            error = std::strerror(errno);
+            return false;
+        }
+        posix_madvise(base, map_size, POSIX_MADV_SEQUENTIAL);
+        posix_madvise(base, map_size, POSIX_MADV_WILLNEED);
+        base_ = base;
+        map_size_ = map_size;
+        data_ = static_cast<const uint8_t*>(base) + (offset - aligned);
+        size_ = size;
+        return true;
+    }
+
+    void reset() {
+        if (base_) {
+            munmap(base_, map_size_);
+            base_ = nullptr;
+            map_size_ = 0;
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+private:
+    void* base_ = nullptr;          ///< 映射起点（页对齐）
+    size_t map_size_ = 0;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/// 一个读请求的结果
+struct ReadCompletion {
+    uint64_t user_data;
+    int64_t result;         ///< 读到的字节数，失败时为 -errno
+};
+
+/**
+ * @brief 基于 io_uring 的批量读取器，直接使用系统调用，不依赖 liburing
+ *
+ * 调用方先用 submitRead 排队最多 depth() 个读请求，再用 wait 一次性提交并等待至少一个完成。
+ * 内核不支持 io_uring 或被禁用（例如容器的 seccomp 策略）、或不支持 IORING_OP_READ（5.1–5.5）时，
+ * submitRead 直接同步 pread，wait 返回已完成的结果，调用方无需区分两种方式。
+ * 运行中 io_uring_enter 出错时同样退回 pread：尚未被内核取走的请求改用 pread 完成，
+ * 已提交的请求照常等待完成，之后的请求都用 pread；fallbackError() 记录出错原因。
+ */
+class UringReader {
+public:
+    explicit UringReader(unsigned depth) : depth_(depth ? depth : 1) {
+#ifdef FRAME_READER_HAS_URING
+        setup();
+#endif
+    }
+
+    ~UringReader() {
+#ifdef FRAME_READER_HAS_URING
+        if (ring_fd_ >= 0) {
+            unmapRing();
+            ::close(ring_fd_);
+        }
+#endif
+    }
+
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+
+    /// 新的读请求是否使用 io_uring（否则为同步 pread）
+    bool usingUring() const { return ring_fd_ >= 0 && fallback_errno_ == 0; }
+
+    /// 运行中退回 pread 的原因（errno），未退回时为 0
+    int fallbackError() const { return fallback_errno_; }
+
+    unsigned depth() const { return depth_; }
+
+    /**
+     * @brief 排队一个读请求，缓冲区在完成前必须保持有效
+     */
+    void submitRead(int fd, void* buffer, size_t length, uint64_t offset, uint64_t user_data) {
+#ifdef FRAME_READER_HAS_URING
+        if (usingUring()) {
+            unsigned tail = sq_tail_local_;
+            unsigned index = tail & *sq_mask_;
+            io_uring_sqe* sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer);
+            sqe->len = static_cast<uint32_t>(length);
+            sqe->off = offset;
+            sqe->user_data = user_data;
+            sq_array_[index] = index;
+            sq_tail_local_ = tail + 1;
+            __atomic_store_n(sq_tail_, sq_tail_local_, __ATOMIC_RELEASE);
+            ++ring_pending_;
+            return;
+        }
+#endif
+        readSync(fd, buffer, length, offset, user_data);
+    }
+
+    /**
+     * @brief 提交排队的请求并等待至少一个完成，结果追加到 out
+     *
+     * 只能在有未完成请求时调用，否则会一直阻塞。
+     */
+    void wait(std::vector<ReadCompletion>& out) {
+        if (!completed_.empty()) {
+            out.insert(out.end(), completed_.begin(), completed_.end());
+            completed_.clear();
+            return;
+        }
+#ifdef FRAME_READER_HAS_URING
+        if (ring_fd_ >= 0 && fallback_errno_ == 0) {
+            while (true) {
+                unsigned to_submit = sq_tail_local_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+                long ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    fallback_errno_ = errno;
+                    readUnsubmitted();
+                    break;
+                }
+                if (reap(out) > 0) {
+                    return;
+                }
+            }
+            if (!completed_.empty()) {
+                out.insert(out.end(), completed_.begin(), completed_.end());
+                completed_.clear();
+                return;
+            }
+        }
+        // 已退回 pread：内核仍持有的请求不再调用 io_uring_enter，轮询完成队列直到它们完成
+        while (ring_pending_ > 0) {
+            if (reap(out) > 0) {
+                return;
+            }
+            usleep(kFallbackPollUs);
+        }
+#endif
+    }
+
+private:
+    /// 同步读满 length 字节，结果放入 completed_
+    void readSync(int fd, void* buffer, size_t length, uint64_t offset, uint64_t user_data) {
+        size_t done = 0;
+        int64_t result = 0;
+        while (done < length) {
+            ssize_t n = pread(fd, static_cast<char*>(buffer) + done, length - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                result = n < 0 ? -errno : 0;
+                break;
+            }
+            done += static_cast<size_t>(n);
+        }
+        completed_.push_back({user_data, done == length ? static_cast<int64_t>(done) : result});
+    }
+
+#ifdef FRAME_READER_HAS_URING
+    static constexpr unsigned kFallbackPollUs = 200;
+
+    void setup() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, depth_, &params));
+        if (fd < 0) {
+            return;
+        }
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            ::close(fd);
+            return;
+        }
+        cq_ptr_ = single ? sq_ptr_
+                         : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = cq_ptr_ == MAP_FAILED ? MAP_FAILED
+                                           : mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+                munmap(cq_ptr_, cq_size_);
+            }
+            munmap(sq_ptr_, sq_size_);
+            ::close(fd);
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        // 5.1–5.5 的内核能创建 io_uring 但不支持 IORING_OP_READ，每个请求都会以 -EINVAL 完成
+        if (!supportsRead(fd)) {
+            unmapRing();
+            ::close(fd);
+            return;
+        }
+
+        char* sq = static_cast<char*>(sq_ptr_);
+        char* cq = static_cast<char*>(cq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sq_tail_local_ = *sq_tail_;
+        depth_ = params.sq_entries;
+        ring_fd_ = fd;
+    }
+
+    /// 用 IORING_REGISTER_PROBE 查询 IORING_OP_READ；探测本身与该操作同在 5.6 加入，探测失败即不支持
+    static bool supportsRead(int fd) {
+        constexpr unsigned kProbeOps = 256;
+        std::vector<char> storage(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) {
+            return false;
+        }
+        return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    void unmapRing() {
+        munmap(sqes_, sqes_size_);
+        if (cq_ptr_ != sq_ptr_) {
+            munmap(cq_ptr_, cq_size_);
+        }
+        munmap(sq_ptr_, sq_size_);
+    }
+
+    /// io_uring_enter 出错后：内核尚未取走的请求改用 pread 完成
+    void readUnsubmitted() {
+        for (unsigned tail = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE); tail != sq_tail_local_; ++tail) {
+            const io_uring_sqe& sqe = sqes_[sq_array_[tail & *sq_mask_]];
+            readSync(sqe.fd, reinterpret_cast<void*>(static_cast<uintptr_t>(sqe.addr)), sqe.len, sqe.off,
+                     sqe.user_data);
+            --ring_pending_;
+        }
+    }
+
+    size_t reap(std::vector<ReadCompletion>& out) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        size_t count = 0;
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            out.push_back({cqe.user_data, cqe.res});
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        ring_pending_ -= count;
+        return count;
+    }
+
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned sq_tail_local_ = 0;
+    size_t ring_pending_ = 0;                   ///< 已交给 io_uring 但还没有取回完成的请求
+#endif
+    int ring_fd_ = -1;
+    int fallback_errno_ = 0;
+    unsigned depth_;
+    std::vector<ReadCompletion> completed_;     ///< pread 完成的请求
+};
+
+#endif // FRAME_READER_POSIX
+
+#endif // FRAME_READER_H
@@ -0,0 +1,375 @@
+#ifndef FRAME_SCAN_H
+#define FRAME_SCAN_H
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include "concurrent_queue.h"
+#include "systrace.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define FRAME_SCAN_GETDENTS 1
+#endif
+
+namespace scan_detail {
+
+inline bool is_name_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '-';
+}
+
+inline char to_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/// 读取 pos 起的十进制数字，至少一位；超出 int 范围时 overflow 置位
+inline bool parse_digits(std::string_view text, size_t& pos, int& value, bool& overflow) {
+    const size_t start = pos;
+    long long result = 0;
+    for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos) {
+        if (result <= INT_MAX) {
+            result = result * 10 + (text[pos] - '0');
+        }
+    }
+    overflow = overflow || result > INT_MAX;
+    value = static_cast<int>(result > INT_MAX ? 0 : result);
+    return pos > start;
+}
+
+/// text[pos] 处是否为 PW<数字>-PH<数字>（不区分大小写）
+inline bool match_resolution(std::string_view text, size_t pos, int& width, int& height, bool& overflow) {
+    if (pos + 2 > text.size() || to_lower(text[pos]) != 'p' || to_lower(text[pos + 1]) != 'w') {
+        return false;
+    }
+    pos += 2;
+    if (!parse_digits(text, pos, width, overflow) || pos + 3 > text.size() || text[pos] != '-' ||
+        to_lower(text[pos + 1]) != 'p' || to_lower(text[pos + 2]) != 'h') {
+        return false;
+    }
+    pos += 3;
+    return parse_digits(text, pos, height, overflow);
+}
+
+} // namespace scan_detail
+
+/**
+ * @brief 从文件名中解析 PW<宽>-PH<高>（不区分大小写），不分配内存
+ *
+ * 与原来的正则 [0-9A-Za-z_-]*PW(\d+)-PH(\d+) 的搜索结果一致：取第一段含匹配的
+ * [0-9A-Za-z_-] 连续字符中最后一处匹配；数值超出 int 范围时失败。
+ */
+inline bool parse_resolution(std::string_view filename, int& width, int& height) {
+    bool found = false;
+    bool found_overflow = false;
+    for (size_t i = 0; i < filename.size(); ++i) {
+        if (!scan_detail::is_name_char(filename[i])) {
+            if (found) {
+                break;
+            }
+            continue;
+        }
+        int w = 0, h = 0;
+        bool overflow = false;
+        if (scan_detail::match_resolution(filename, i, w, h, overflow)) {
+            found = true;
+            found_overflow = overflow;
+            width = w;
+            height = h;
+        }
+    }
+    return found && !found_overflow;
+}
+
+/// 扫描到的一个输入文件
+struct ScanEntry {
+    std::string relative_path;  ///< 相对扫描根目录的路径，以 / 分隔
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;       ///< 与 std::filesystem::file_time_type 相同的纪元
+    int width = 0;              ///< 文件名中没有分辨率时为 0
+    int height = 0;
+};
+
+/**
+ * @brief 多线程扫描目录中的 .nv21 文件，边扫描边通过 next() 交出结果
+ *
+ * Linux 上用 getdents64 按批读取目录项（每批约一千项），每批的 stat 作为独立任务
+ * 交给空闲的扫描线程，子目录也作为任务并行展开，单个大目录和深目录树都能并行。
+ * 其他平台退回到单线程的 std::filesystem 遍历。
+ * 结果顺序不确定；不跟随指向目录的符号链接，跳过名为 exclude 的顶层子目录（输出目录）。
+ */
+class FrameScanner {
+public:
+    FrameScanner(std::filesystem::path root, bool recursive, size_t threads, std::string exclude)
+        : root_(std::move(root)), recursive_(recursive), exclude_(std::move(exclude)),
+          results_(threadCount(threads), 1, kResultCapacity) {
+#ifdef FRAME_SCAN_GETDENTS
+        root_fd_ = ::open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (root_fd_ < 0) {
+            std::cerr << "Error scanning: " << root_ << ": " << std::strerror(errno) << std::endl;
+        } else {
+            pushTask({nullptr, std::string(), {}});
+        }
+#endif
+        for (size_t i = 0; i < threadCount(threads); ++i) {
+            threads_.emplace_back([this, i]() {
+                TRACE_SET_THREAD_NAME("ScanThread-" + std::to_string(i));
+                run();
+                results_.producerDone();
+            });
+        }
+    }
+
+    FrameScanner(const FrameScanner&) = delete;
+    FrameScanner& operator=(const FrameScanner&) = delete;
+
+    ~FrameScanner() {
+        // 提前结束时先取完剩余结果，扫描线程才不会阻塞在满队列上
+        ScanEntry entry;
+        while (next(entry)) {
+        }
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+#ifdef FRAME_SCAN_GETDENTS
+        if (root_fd_ >= 0) {
+            ::close(root_fd_);
+        }
+#endif
+    }
+
+    /// 取下一个扫描结果，扫描结束且已全部取出时返回 false
+    bool next(ScanEntry& entry) {
+        return results_.pop(entry);
+    }
+
+private:
+    static constexpr size_t kResultCapacity = 1024;
+
+    static size_t threadCount(size_t requested) {
+#ifdef FRAME_SCAN_GETDENTS
+        return requested ? requested : 1;
+#else
+        (void)requested;
+        return 1;
+#endif
+    }
+
+    static bool isInput(std::string_view name) {
+        return name.size() > 5 && (name.substr(name.size() - 5) == ".nv21" || name.substr(name.size() - 5) == ".NV21");
+    }
+
+    void emit(std::string relative_path, uint64_t size, int64_t mtime_ns) {
+        ScanEntry entry{std::move(relative_path), size, mtime_ns, 0, 0};
+        const size_t slash = entry.relative_path.rfind('/');
+        parse_resolution(std::string_view(entry.relative_path).substr(slash == std::string::npos ? 0 : slash + 1),
+                         entry.width, entry.height);
+        results_.push(std::move(entry));
+    }
+
+#ifdef FRAME_SCAN_GETDENTS
+    /// 打开的目录，最后一个引用它的任务完成时关闭
+    struct Directory {
+        int fd = -1;
+        std::string relative_path;
+        ~Directory() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    };
+
+    /// 任务：dir 为空时列出 relative_path 目录，否则 stat dir 中的 names
+    struct Task {
+        std::shared_ptr<Directory> dir;
+        std::string relative_path;
+        std::vector<std::string> names;
+    };
+
+    /// getdents64 返回的目录项布局（linux_dirent64）
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    static constexpr size_t kDirentBufferSize = 64 * 1024;
+
+    /// std::filesystem::file_time_type 的纪元与 Unix 纪元相差整数秒（libstdc++ 为 2174 年）
+    static int64_t fileClockOffsetNs() {
+        static const int64_t offset = []() {
+            using namespace std::chrono;
+            const auto file_now = duration_cast<nanoseconds>(
+                std::filesystem::file_time_type::clock::now().time_since_epoch());
+            const auto sys_now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch());
+            return duration_cast<nanoseconds>(round<seconds>(file_now - sys_now)).count();
+        }();
+        return offset;
+    }
+
+    static std::string childPath(const std::string& parent, const char* name) {
+        return parent.empty() ? std::string(name) : parent + "/" + name;
+    }
+
+    void pushTask(Task task) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+        ++pending_;
+        cond_.notify_one();
+    }
+
+    void pushDirectory(std::string relative_path) {
+        if (relative_path != exclude_) {
+            pushTask({nullptr, std::move(relative_path), {}});
+        }
+    }
+
+    void run() {
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]() { return !tasks_.empty() || pending_ == 0; });
+                if (tasks_.empty()) {
+                    return;
+                }
+                // 后进先出：先处理刚读出的一批，打开的目录数保持在少量
+                task = std::move(tasks_.back());
+                tasks_.pop_back();
+            }
+            if (task.dir) {
+                statNames(*task.dir, task.names);
+            } else {
+                listDirectory(task.relative_path);
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) {
+                cond_.notify_all();
+            }
+        }
+    }
+
+    void listDirectory(const std::string& relative_path) {
+        TRACE_SCOPE_ARGS(io, "ScanDirectory", TRACE_ARG("dir", relative_path));
+        auto dir = std::make_shared<Directory>();
+        dir->relative_path = relative_path;
+        dir->fd = relative_path.empty() ? ::dup(root_fd_)
+                                        : ::openat(root_fd_, relative_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir->fd < 0) {
+            std::cerr << "Error scanning: " << root_ / relative_path << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        std::vector<char> buffer(kDirentBufferSize);
+        while (true) {
+            const long bytes = ::syscall(SYS_getdents64, dir->fd, buffer.data(), buffer.size());
+            if (bytes <= 0) {
+                if (bytes < 0) {
+                    std::cerr << "Error scanning: " << root_ / relative_path << ": " << std::strerror(errno) << std::endl;
+                }
+                return;
+            }
+            // 目录项类型已知时不必 stat 就能分出子目录和无关文件，只有候选输入才需要 stat
+            std::vector<std::string> names;
+            for (long offset = 0; offset < bytes;) {
+                const auto* entry = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+                offset += entry->d_reclen;
+                const char* name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+                if (entry->d_type == DT_DIR) {
+                    if (recursive_) {
+                        pushDirectory(childPath(relative_path, name));
+                    }
+                } else if (isInput(name) || (entry->d_type == DT_UNKNOWN && recursive_)) {
+                    names.emplace_back(name);
+                }
+            }
+            if (!names.empty()) {
+                pushTask({dir, std::string(), std::move(names)});
+            }
+        }
+    }
+
+    void statNames(const Directory& dir, const std::vector<std::string>& names) {
+        TRACE_SCOPE_ARGS(io, "StatBatch", TRACE_ARG("dir", dir.relative_path), TRACE_ARG("count", names.size()));
+        for (const std::string& name : names) {
+            struct stat st;
+            if (::fstatat(dir.fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                if (recursive_) {
+                    pushDirectory(childPath(dir.relative_path, name.c_str()));
+                }
+                continue;
+            }
+            if (!isInput(name) || (S_ISLNK(st.st_mode) && ::fstatat(dir.fd, name.c_str(), &st, 0) != 0) ||
+                !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            const int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+            emit(childPath(dir.relative_path, name.c_str()), static_cast<uint64_t>(st.st_size),
+                 mtime_ns + fileClockOffsetNs());
+        }
+    }
+
+    int root_fd_ = -1;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<Task> tasks_;
+    size_t pending_ = 0;    ///< 排队和正在处理的任务数，为 0 时扫描结束
+#else
+    void run() {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        auto visit = [&](const fs::directory_entry& entry) {
+            if (!entry.is_regular_file(ec) || !isInput(entry.path().filename().string())) {
+                return;
+            }
+            const uint64_t size = entry.file_size(ec);
+            const int64_t mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                entry.last_write_time(ec).time_since_epoch()).count();
+            emit(entry.path().lexically_relative(root_).generic_string(), size, mtime_ns);
+        };
+        if (!recursive_) {
+            for (const auto& entry : fs::directory_iterator(root_, ec)) {
+                visit(entry);
+            }
+            return;
+        }
+        const fs::path exclude = root_ / exclude_;
+        for (auto it = fs::recursive_directory_iterator(root_, fs::directory_options::skip_permission_denied, ec);
+             it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->path() == exclude) {
+                it.disable_recursion_pending();
+                continue;
+            }
+            visit(*it);
+        }
+    }
+#endif
+
+    const std::filesystem::path root_;
+    const bool recursive_;
+    const std::string exclude_;
+    ConcurrentQueue<ScanEntry> results_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // FRAME_SCAN_H
@@ -0,0 +1,198 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include "systrace.h"
+
+class MemoryBudget;
+
+/**
+ * @brief 从 MemoryBudget 借出的字节额度，析构时归还剩余部分
+ *
+ * 只能移动不能拷贝，随数据项在流水线各阶段之间传递；可以分几次归还（release）。
+ */
+class BudgetTicket {
+public:
+    BudgetTicket() = default;
+
+    BudgetTicket(BudgetTicket&& other) noexcept
+        : budget_(other.budget_), bytes_(other.bytes_), metadata_(other.metadata_) {
+        other.budget_ = nullptr;
+        other.bytes_ = 0;
+    }
+
+    BudgetTicket& operator=(BudgetTicket&& other) noexcept {
+        if (this != &other) {
+            reset();
+            budget_ = other.budget_;
+            bytes_ = other.bytes_;
+            metadata_ = other.metadata_;
+            other.budget_ = nullptr;
+            other.bytes_ = 0;
+        }
+        return *this;
+    }
+
+    BudgetTicket(const BudgetTicket&) = delete;
+    BudgetTicket& operator=(const BudgetTicket&) = delete;
+
+    ~BudgetTicket() {
+        reset();
+    }
+
+    size_t bytes() const { return bytes_; }
+
+    /// 提前归还其中 bytes 字节（不超过剩余额度）
+    inline void release(size_t bytes);
+
+    /// 归还全部剩余额度
+    void reset() { release(bytes_); }
+
+private:
+    friend class MemoryBudget;
+
+    BudgetTicket(MemoryBudget* budget, size_t bytes, bool metadata)
+        : budget_(budget), bytes_(bytes), metadata_(metadata) {}
+
+    MemoryBudget* budget_ = nullptr;
+    size_t bytes_ = 0;
+    bool metadata_ = false;
+};
+
+/**
+ * @brief 全流水线共享的内存预算（字节）
+ *
+ * 数据进入流水线时按它在各阶段最多占用的字节数借出额度，额度不够时借用方阻塞，
+ * 下游处理完逐步归还。limit 为 0 表示不限，此时只统计用量。
+ * 没有帧数据在途时总是放行一项，单帧超过整个预算也不会卡死。
+ * 只含元数据的队列项（文件队列）用 acquireMetadata 借出：同样计入用量，
+ * 但不算作"帧数据在途"，否则读取线程会等待只有它自己才能取出的文件项。
+ */
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limit) : limit_(limit) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    /// 为帧数据借出 bytes 字节，额度不够时阻塞
+    BudgetTicket acquire(size_t bytes) {
+        return acquire(bytes, false);
+    }
+
+    /// 为只含元数据的队列项借出 bytes 字节，额度不够时阻塞
+    BudgetTicket acquireMetadata(size_t bytes) {
+        return acquire(bytes, true);
+    }
+
+    /// 不阻塞地借出，额度不够时返回 false
+    bool tryAcquire(size_t bytes, BudgetTicket& ticket) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!fits(bytes)) {
+                return false;
+            }
+            take(bytes, false);
+        }
+        ticket = BudgetTicket(this, bytes, false);
+        return true;
+    }
+
+    size_t limit() const { return limit_; }
+
+    size_t used() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return used_;
+    }
+
+    size_t peak() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return peak_;
+    }
+
+private:
+    friend class BudgetTicket;
+
+    BudgetTicket acquire(size_t bytes, bool metadata) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!fits(bytes)) {
+            TRACE_SCOPE(queue, "WaitForMemoryBudget");
+            cond_.wait(lock);
+        }
+        take(bytes, metadata);
+        return BudgetTicket(this, bytes, metadata);
+    }
+
+    bool fits(size_t bytes) const { return limit_ == 0 || used_ == metadata_ || used_ + bytes <= limit_; }
+
+    void take(size_t bytes, bool metadata) {
+        used_ += bytes;
+        if (metadata) {
+            metadata_ += bytes;
+        }
+        if (used_ > peak_) {
+            peak_ = used_;
+        }
+    }
+
+    void release(size_t bytes, bool metadata) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_ -= bytes;
+        if (metadata) {
+            metadata_ -= bytes;
+        }
+        cond_.notify_all();
+    }
+
+    const size_t limit_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    size_t used_ = 0;
+    size_t metadata_ = 0;   ///< used_ 中元数据所占部分
+    size_t peak_ = 0;
+};
+
+inline void BudgetTicket::release(size_t bytes) {
+    if (bytes > bytes_) {
+        bytes = bytes_;
+    }
+    if (budget_ && bytes > 0) {
+        budget_->release(bytes, metadata_);
+        bytes_ -= bytes;
+    }
+    if (bytes_ == 0) {
+        budget_ = nullptr;
+    }
+}
+
+/// 解析字节数，可带 K/M/G 后缀（1024 进制），例如 "512M"、"2G"
+inline bool parse_byte_size(const std::string& text, size_t& bytes) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || text[0] == '-') {
+        return false;
+    }
+    int shift = 0;
+    switch (*end) {
+        case '\0': break;
+        case 'k': case 'K': shift = 10; ++end; break;
+        case 'm': case 'M': shift = 20; ++end; break;
+        case 'g': case 'G': shift = 30; ++end; break;
+        default: return false;
+    }
+    if (*end == 'B' || *end == 'b') {
+        ++end;
+    }
+    if (*end != '\0' || value == 0 || value > (~0ull >> shift)) {
+        return false;
+    }
+    bytes = static_cast<size_t>(value << shift);
+    return true;
+}
+
+#endif // MEMORY_BUDGET_H
@@ -0,0 +1,481 @@
+#ifndef NV21_CONVERT_H
+#define NV21_CONVERT_H
+
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define NV21_HAS_X86_KERNELS 1
+#define NV21_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/// BT.601 取值范围
+enum class YuvRange {
+    Limited,    ///< Y 16..235，UV 16..240（与 cv::COLOR_YUV2BGR_NV21 一致）
+    Full,       ///< Y/UV 0..255（JPEG）
+};
+
+/// 输出像素的通道顺序
+enum class PixelOrder { BGR, RGB };
+
+/// 转换内核，运行时按 CPUID 选择
+enum class Nv21Kernel { Scalar, SSE41, AVX2, AVX512 };
+
+inline const char* nv21_kernel_name(Nv21Kernel kernel) {
+    switch (kernel) {
+        case Nv21Kernel::SSE41: return "sse4.1";
+        case Nv21Kernel::AVX2: return "avx2";
+        case Nv21Kernel::AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+/// 当前 CPU 是否支持该内核
+inline bool nv21_kernel_supported(Nv21Kernel kernel) {
+    switch (kernel) {
+        case Nv21Kernel::Scalar: return true;
+#ifdef NV21_HAS_X86_KERNELS
+        case Nv21Kernel::SSE41: return __builtin_cpu_supports("sse4.1");
+        case Nv21Kernel::AVX2: return __builtin_cpu_supports("avx2");
+        case Nv21Kernel::AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+        default: return false;
+    }
+}
+
+/// 当前 CPU 支持的最快内核
+inline Nv21Kernel nv21_best_kernel() {
+    for (Nv21Kernel kernel : {Nv21Kernel::AVX512, Nv21Kernel::AVX2, Nv21Kernel::SSE41}) {
+        if (nv21_kernel_supported(kernel)) {
+            return kernel;
+        }
+    }
+    return Nv21Kernel::Scalar;
+}
+
+/// 解析 auto|scalar|sse4.1|avx2|avx512，auto 选择最快的内核；不支持的内核返回 false
+inline bool parse_nv21_kernel(const std::string& name, Nv21Kernel& kernel) {
+    if (name == "auto") {
+        kernel = nv21_best_kernel();
+        return true;
+    }
+    for (Nv21Kernel candidate : {Nv21Kernel::Scalar, Nv21Kernel::SSE41, Nv21Kernel::AVX2, Nv21Kernel::AVX512}) {
+        if (name == nv21_kernel_name(candidate)) {
+            kernel = candidate;
+            return nv21_kernel_supported(candidate);
+        }
+    }
+    return false;
+}
+
+namespace nv21_detail {
+
+/**
+ * 20 位定点系数。Limited 与 OpenCV 的 ITUR_BT_601_* 常数相同：
+ *   Y' = max(Y - y_offset, 0) * cy
+ *   R = (Y' + cvr*V + 2^19) >> 20
+ *   G = (Y' + cvg*V + cug*U + 2^19) >> 20
+ *   B = (Y' + cub*U + 2^19) >> 20      (U, V 已减去 128)
+ * 各项最大约 5e8，所有内核都在 32 位整数中计算，因此结果完全一致。
+ */
+struct Coeffs {
+    int32_t y_offset, cy, cvr, cvg, cug, cub;
+};
+
+constexpr int kShift = 20;
+constexpr int32_t kRound = 1 << (kShift - 1);
+constexpr Coeffs kLimited{16, 1220542, 1673527, -852492, -409993, 2116026};
+constexpr Coeffs kFull{0, 1 << kShift, 1470104, -748830, -360857, 1858077};
+
+inline const Coeffs& coeffs(YuvRange range) {
+    return range == YuvRange::Full ? kFull : kLimited;
+}
+
+inline uint8_t clamp_u8(int32_t v) {
+    return static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+/// 转换一个像素，p 指向输出的 3 字节
+inline void pixel_scalar(int32_t y, int32_t v, int32_t u, uint8_t* p, const Coeffs& c, bool rgb) {
+    y -= c.y_offset;
+    y = (y < 0 ? 0 : y) * c.cy;
+    v -= 128;
+    u -= 128;
+    p[rgb ? 2 : 0] = clamp_u8((y + c.cub * u + kRound) >> kShift);
+    p[1] = clamp_u8((y + c.cvg * v + c.cug * u + kRound) >> kShift);
+    p[rgb ? 0 : 2] = clamp_u8((y + c.cvr * v + kRound) >> kShift);
+}
+
+/// 标量参考实现：转换 [x_begin, width) 的像素
+inline void row_scalar(const uint8_t* y_row, const uint8_t* vu_row, int x_begin, int width, uint8_t* dst,
+                       const Coeffs& c, bool rgb) {
+    for (int x = x_begin; x < width; ++x) {
+        pixel_scalar(y_row[x], vu_row[x & ~1], vu_row[x | 1], dst + static_cast<size_t>(x) * 3, c, rgb);
+    }
+}
+
+/**
+ * 缩小 2^shift 倍并转换一行（shift >= 1）：亮度取 f×f 块的均值，色度取同一区域内
+ * (f/2)×(f/2) 个 VU 样本的均值，f = 2^shift。输出像素与色度网格对齐，
+ * 每个输出像素都有自己的色度，不需要先生成全分辨率图像。
+ * y_rows / vu_rows 指向该输出行覆盖的第一行亮度 / 色度。块大小是模板参数，内层循环可以完全展开。
+ */
+template <int Shift>
+void row_downscale(const uint8_t* y_rows, const uint8_t* vu_rows, int width, int out_width, uint8_t* dst,
+                   const Coeffs& c, bool rgb) {
+    constexpr int factor = 1 << Shift;
+    constexpr int half = factor / 2;
+    constexpr int shift = Shift;
+    constexpr uint32_t y_round = 1u << (2 * shift - 1);
+    constexpr uint32_t c_round = (1u << (2 * shift - 2)) >> 1;
+    for (int x = 0; x < out_width; ++x) {
+        const size_t col = static_cast<size_t>(x) * factor;
+        uint32_t y_sum = 0;
+        for (int dy = 0; dy < factor; ++dy) {
+            const uint8_t* p = y_rows + static_cast<size_t>(dy) * width + col;
+            for (int dx = 0; dx < factor; ++dx) {
+                y_sum += p[dx];
+            }
+        }
+        uint32_t v_sum = 0, u_sum = 0;
+        for (int dy = 0; dy < half; ++dy) {
+            const uint8_t* p = vu_rows + static_cast<size_t>(dy) * width + col;
+            for (int dx = 0; dx < factor; dx += 2) {
+                v_sum += p[dx];
+                u_sum += p[dx + 1];
+            }
+        }
+        pixel_scalar(static_cast<int32_t>((y_sum + y_round) >> (2 * shift)),
+                     static_cast<int32_t>((v_sum + c_round) >> (2 * shift - 2)),
+                     static_cast<int32_t>((u_sum + c_round) >> (2 * shift - 2)), dst + static_cast<size_t>(x) * 3, c,
+                     rgb);
+    }
+}
+
+#ifdef NV21_HAS_X86_KERNELS
+
+/// pshufb 掩码：三个平面寄存器 -> 48 字节交错 BGR 中的第 k 个 16 字节，[k][通道][字节]
+struct InterleaveMasks {
+    int8_t m[3][3][16];
+};
+
+constexpr InterleaveMasks make_interleave_masks() {
+    InterleaveMasks masks{};
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < 16; ++i) {
+                int j = k * 16 + i;
+                masks.m[k][c][i] = static_cast<int8_t>(j % 3 == c ? j / 3 : -128);
+            }
+        }
+    }
+    return masks;
+}
+
+alignas(16) inline constexpr InterleaveMasks kInterleave = make_interleave_masks();
+
+/// 每个 Y 像素对应的 V / U：NV21 的色度平面为 VUVU...，16 字节对应 16 个像素
+alignas(16) inline constexpr int8_t kDupV[16] = {0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14};
+alignas(16) inline constexpr int8_t kDupU[16] = {1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15};
+
+/// 把 16 个像素的三个通道交错写成 48 字节
+NV21_TARGET("sse4.1")
+inline void store_interleaved16(uint8_t* dst, __m128i c0, __m128i c1, __m128i c2) {
+    for (int k = 0; k < 3; ++k) {
+        const auto& m = kInterleave.m[k];
+        __m128i out = _mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(c0, _mm_load_si128(reinterpret_cast<const __m128i*>(m[0]))),
+                         _mm_shuffle_epi8(c1, _mm_load_si128(reinterpret_cast<const __m128i*>(m[1])))),
+            _mm_shuffle_epi8(c2, _mm_load_si128(reinterpret_cast<const __m128i*>(m[2]))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k * 16), out);
+    }
+}
+
+/*
+ * SIMD 内核的结构相同：一次加载 N 个 Y 和 N 个 VU 字节（N/2 对色度），pshufb 把 V、U 复制到每个像素，
+ * 逐级 unpack 扩展成 32 位后按标量公式计算，再用 packs/packus 收窄并饱和到 0..255。
+ * unpack 和 pack 都在 128 位通道内进行，两者互逆，像素顺序不变，不需要跨通道重排；
+ * 最后每 16 个像素用 pshufb 交错成 48 字节的 BGR。
+ */
+
+/// 4 个像素：y/u/v 为 32 位，返回右移后的 B/G/R（未饱和）
+NV21_TARGET("sse4.1")
+inline void pixels_sse41(__m128i y, __m128i u, __m128i v, const Coeffs& c, __m128i& b, __m128i& g, __m128i& r) {
+    const __m128i c128 = _mm_set1_epi32(128);
+    const __m128i round = _mm_set1_epi32(kRound);
+    y = _mm_mullo_epi32(_mm_max_epi32(_mm_sub_epi32(y, _mm_set1_epi32(c.y_offset)), _mm_setzero_si128()),
+                        _mm_set1_epi32(c.cy));
+    y = _mm_add_epi32(y, round);
+    u = _mm_sub_epi32(u, c128);
+    v = _mm_sub_epi32(v, c128);
+    b = _mm_srai_epi32(_mm_add_epi32(y, _mm_mullo_epi32(u, _mm_set1_epi32(c.cub))), kShift);
+    g = _mm_srai_epi32(_mm_add_epi32(y, _mm_add_epi32(_mm_mullo_epi32(v, _mm_set1_epi32(c.cvg)),
+                                                      _mm_mullo_epi32(u, _mm_set1_epi32(c.cug)))), kShift);
+    r = _mm_srai_epi32(_mm_add_epi32(y, _mm_mullo_epi32(v, _mm_set1_epi32(c.cvr))), kShift);
+}
+
+NV21_TARGET("sse4.1")
+inline void row_sse41(const uint8_t* y_row, const uint8_t* vu_row, int width, uint8_t* dst, const Coeffs& c,
+                      bool rgb) {
+    const __m128i dup_v = _mm_load_si128(reinterpret_cast<const __m128i*>(kDupV));
+    const __m128i dup_u = _mm_load_si128(reinterpret_cast<const __m128i*>(kDupU));
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y_row + x));
+        __m128i vu8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vu_row + x));
+        __m128i v8 = _mm_shuffle_epi8(vu8, dup_v);
+        __m128i u8 = _mm_shuffle_epi8(vu8, dup_u);
+        __m128i b16[2], g16[2], r16[2];
+        for (int h = 0; h < 2; ++h) {
+            __m128i y16 = h ? _mm_unpackhi_epi8(y8, zero) : _mm_unpacklo_epi8(y8, zero);
+            __m128i u16 = h ? _mm_unpackhi_epi8(u8, zero) : _mm_unpacklo_epi8(u8, zero);
+            __m128i v16 = h ? _mm_unpackhi_epi8(v8, zero) : _mm_unpacklo_epi8(v8, zero);
+            __m128i b0, g0, r0, b1, g1, r1;
+            pixels_sse41(_mm_unpacklo_epi16(y16, zero), _mm_unpacklo_epi16(u16, zero),
+                         _mm_unpacklo_epi16(v16, zero), c, b0, g0, r0);
+            pixels_sse41(_mm_unpackhi_epi16(y16, zero), _mm_unpackhi_epi16(u16, zero),
+                         _mm_unpackhi_epi16(v16, zero), c, b1, g1, r1);
+            b16[h] = _mm_packs_epi32(b0, b1);
+            g16[h] = _mm_packs_epi32(g0, g1);
+            r16[h] = _mm_packs_epi32(r0, r1);
+        }
+        __m128i b = _mm_packus_epi16(b16[0], b16[1]);
+        __m128i g = _mm_packus_epi16(g16[0], g16[1]);
+        __m128i r = _mm_packus_epi16(r16[0], r16[1]);
+        store_interleaved16(dst + x * 3, rgb ? r : b, g, rgb ? b : r);
+    }
+    row_scalar(y_row, vu_row, x, width, dst, c, rgb);
+}
+
+/// 8 个像素（每个 128 位通道 4 个）
+NV21_TARGET("avx2")
+inline void pixels_avx2(__m256i y, __m256i u, __m256i v, const Coeffs& c, __m256i& b, __m256i& g, __m256i& r) {
+    const __m256i c128 = _mm256_set1_epi32(128);
+    const __m256i round = _mm256_set1_epi32(kRound);
+    y = _mm256_mullo_epi32(
+        _mm256_max_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(c.y_offset)), _mm256_setzero_si256()),
+        _mm256_set1_epi32(c.cy));
+    y = _mm256_add_epi32(y, round);
+    u = _mm256_sub_epi32(u, c128);
+    v = _mm256_sub_epi32(v, c128);
+    b = _mm256_srai_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(u, _mm256_set1_epi32(c.cub))), kShift);
+    g = _mm256_srai_epi32(_mm256_add_epi32(y, _mm256_add_epi32(_mm256_mullo_epi32(v, _mm256_set1_epi32(c.cvg)),
+                                                               _mm256_mullo_epi32(u, _mm256_set1_epi32(c.cug)))),
+                          kShift);
+    r = _mm256_srai_epi32(_mm256_add_epi32(y, _mm256_mullo_epi32(v, _mm256_set1_epi32(c.cvr))), kShift);
+}
+
+NV21_TARGET("avx2")
+inline void row_avx2(const uint8_t* y_row, const uint8_t* vu_row, int width, uint8_t* dst, const Coeffs& c,
+                     bool rgb) {
+    const __m256i dup_v = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kDupV)));
+    const __m256i dup_u = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kDupU)));
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i y8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y_row + x));
+        __m256i vu8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vu_row + x));
+        __m256i v8 = _mm256_shuffle_epi8(vu8, dup_v);
+        __m256i u8 = _mm256_shuffle_epi8(vu8, dup_u);
+        __m256i b16[2], g16[2], r16[2];
+        for (int h = 0; h < 2; ++h) {
+            __m256i y16 = h ? _mm256_unpackhi_epi8(y8, zero) : _mm256_unpacklo_epi8(y8, zero);
+            __m256i u16 = h ? _mm256_unpackhi_epi8(u8, zero) : _mm256_unpacklo_epi8(u8, zero);
+            __m256i v16 = h ? _mm256_unpackhi_epi8(v8, zero) : _mm256_unpacklo_epi8(v8, zero);
+            __m256i b0, g0, r0, b1, g1, r1;
+            pixels_avx2(_mm256_unpacklo_epi16(y16, zero), _mm256_unpacklo_epi16(u16, zero),
+                        _mm256_unpacklo_epi16(v16, zero), c, b0, g0, r0);
+            pixels_avx2(_mm256_unpackhi_epi16(y16, zero), _mm256_unpackhi_epi16(u16, zero),
+                        _mm256_unpackhi_epi16(v16, zero), c, b1, g1, r1);
+            b16[h] = _mm256_packs_epi32(b0, b1);
+            g16[h] = _mm256_packs_epi32(g0, g1);
+            r16[h] = _mm256_packs_epi32(r0, r1);
+        }
+        __m256i b = _mm256_packus_epi16(b16[0], b16[1]);
+        __m256i g = _mm256_packus_epi16(g16[0], g16[1]);
+        __m256i r = _mm256_packus_epi16(r16[0], r16[1]);
+        if (rgb) std::swap(b, r);
+        store_interleaved16(dst + x * 3, _mm256_castsi256_si128(b), _mm256_castsi256_si128(g),
+                            _mm256_castsi256_si128(r));
+        store_interleaved16(dst + x * 3 + 48, _mm256_extracti128_si256(b, 1), _mm256_extracti128_si256(g, 1),
+                            _mm256_extracti128_si256(r, 1));
+    }
+    row_sse41(y_row + x, vu_row + x, width - x, dst + x * 3, c, rgb);
+}
+
+// GCC 12 的 AVX-512 intrinsics 内联时对 _mm512_undefined_* 误报未初始化
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+/// 16 个像素（每个 128 位通道 4 个）
+NV21_TARGET("avx512f,avx512bw")
+inline void pixels_avx512(__m512i y, __m512i u, __m512i v, const Coeffs& c, __m512i& b, __m512i& g, __m512i& r) {
+    const __m512i c128 = _mm512_set1_epi32(128);
+    const __m512i round = _mm512_set1_epi32(kRound);
+    y = _mm512_mullo_epi32(
+        _mm512_max_epi32(_mm512_sub_epi32(y, _mm512_set1_epi32(c.y_offset)), _mm512_setzero_si512()),
+        _mm512_set1_epi32(c.cy));
+    y = _mm512_add_epi32(y, round);
+    u = _mm512_sub_epi32(u, c128);
+    v = _mm512_sub_epi32(v, c128);
+    b = _mm512_srai_epi32(_mm512_add_epi32(y, _mm512_mullo_epi32(u, _mm512_set1_epi32(c.cub))), kShift);
+    g = _mm512_srai_epi32(_mm512_add_epi32(y, _mm512_add_epi32(_mm512_mullo_epi32(v, _mm512_set1_epi32(c.cvg)),
+                                                               _mm512_mullo_epi32(u, _mm512_set1_epi32(c.cug)))),
+                          kShift);
+    r = _mm512_srai_epi32(_mm512_add_epi32(y, _mm512_mullo_epi32(v, _mm512_set1_epi32(c.cvr))), kShift);
+}
+
+NV21_TARGET("avx512f,avx512bw")
+inline void row_avx512(const uint8_t* y_row, const uint8_t* vu_row, int width, uint8_t* dst, const Coeffs& c,
+                       bool rgb) {
+    const __m512i dup_v = _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(kDupV)));
+    const __m512i dup_u = _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(kDupU)));
+    const __m512i zero = _mm512_setzero_si512();
+    int x = 0;
+    for (; x + 64 <= width; x += 64) {
+        __m512i y8 = _mm512_loadu_si512(y_row + x);
+        __m512i vu8 = _mm512_loadu_si512(vu_row + x);
+        __m512i v8 = _mm512_shuffle_epi8(vu8, dup_v);
+        __m512i u8 = _mm512_shuffle_epi8(vu8, dup_u);
+        __m512i b16[2], g16[2], r16[2];
+        for (int h = 0; h < 2; ++h) {
+            __m512i y16 = h ? _mm512_unpackhi_epi8(y8, zero) : _mm512_unpacklo_epi8(y8, zero);
+            __m512i u16 = h ? _mm512_unpackhi_epi8(u8, zero) : _mm512_unpacklo_epi8(u8, zero);
+            __m512i v16 = h ? _mm512_unpackhi_epi8(v8, zero) : _mm512_unpacklo_epi8(v8, zero);
+            __m512i b0, g0, r0, b1, g1, r1;
+            pixels_avx512(_mm512_unpacklo_epi16(y16, zero), _mm512_unpacklo_epi16(u16, zero),
+                          _mm512_unpacklo_epi16(v16, zero), c, b0, g0, r0);
+            pixels_avx512(_mm512_unpackhi_epi16(y16, zero), _mm512_unpackhi_epi16(u16, zero),
+                          _mm512_unpackhi_epi16(v16, zero), c, b1, g1, r1);
+            b16[h] = _mm512_packs_epi32(b0, b1);
+            g16[h] = _mm512_packs_epi32(g0, g1);
+            r16[h] = _mm512_packs_epi32(r0, r1);
+        }
+        __m512i b = _mm512_packus_epi16(b16[0], b16[1]);
+        __m512i g = _mm512_packus_epi16(g16[0], g16[1]);
+        __m512i r = _mm512_packus_epi16(r16[0], r16[1]);
+        if (rgb) std::swap(b, r);
+        uint8_t* out = dst + x * 3;
+        store_interleaved16(out, _mm512_extracti32x4_epi32(b, 0), _mm512_extracti32x4_epi32(g, 0),
+                            _mm512_extracti32x4_epi32(r, 0));
+        store_interleaved16(out + 48, _mm512_extracti32x4_epi32(b, 1), _mm512_extracti32x4_epi32(g, 1),
+                            _mm512_extracti32x4_epi32(r, 1));
+        store_interleaved16(out + 96, _mm512_extracti32x4_epi32(b, 2), _mm512_extracti32x4_epi32(g, 2),
+                            _mm512_extracti32x4_epi32(r, 2));
+        store_interleaved16(out + 144, _mm512_extracti32x4_epi32(b, 3), _mm512_extracti32x4_epi32(g, 3),
+                            _mm512_extracti32x4_epi32(r, 3));
+    }
+    row_avx2(y_row + x, vu_row + x, width - x, dst + x * 3, c, rgb);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // NV21_HAS_X86_KERNELS
+
+} // namespace nv21_detail
+
+/**
+ * @brief NV21 -> BGR/RGB 转换器，按行输出，可以直接写入编码器的行缓冲区
+ *
+ * NV21 帧为 width*height 的 Y 平面后接 width*height/2 的 VU 交错平面，宽高必须为偶数。
+ * 所有内核与标量实现逐位一致。
+ */
+class Nv21Converter {
+public:
+    explicit Nv21Converter(Nv21Kernel kernel = nv21_best_kernel(), YuvRange range = YuvRange::Limited,
+                           PixelOrder order = PixelOrder::BGR)
+        : kernel_(nv21_kernel_supported(kernel) ? kernel : Nv21Kernel::Scalar), range_(range), order_(order) {}
+
+    /// 帧尺寸能否转换：宽高为正偶数。奇数尺寸的色度平面不足 width*height/2，转换会读出帧外
+    static bool validSize(int width, int height) {
+        return width > 0 && height > 0 && width % 2 == 0 && height % 2 == 0;
+    }
+
+    Nv21Kernel kernel() const { return kernel_; }
+    YuvRange range() const { return range_; }
+    PixelOrder order() const { return order_; }
+
+    /// 转换第 row 行，dst 写入 width*3 字节
+    void convertRow(const uint8_t* frame, int width, int height, int row, uint8_t* dst) const {
+        const uint8_t* y_row = frame + static_cast<size_t>(row) * width;
+        const uint8_t* vu_row = frame + static_cast<size_t>(width) * height + static_cast<size_t>(row / 2) * width;
+        const nv21_detail::Coeffs& c = nv21_detail::coeffs(range_);
+        const bool rgb = order_ == PixelOrder::RGB;
+        switch (kernel_) {
+#ifdef NV21_HAS_X86_KERNELS
+            case Nv21Kernel::AVX512: nv21_detail::row_avx512(y_row, vu_row, width, dst, c, rgb); break;
+            case Nv21Kernel::AVX2: nv21_detail::row_avx2(y_row, vu_row, width, dst, c, rgb); break;
+            case Nv21Kernel::SSE41: nv21_detail::row_sse41(y_row, vu_row, width, dst, c, rgb); break;
+#endif
+            default: nv21_detail::row_scalar(y_row, vu_row, 0, width, dst, c, rgb); break;
+        }
+    }
+
+    /// 转换 [row_begin, row_end) 行，相邻两行输出相距 dst_stride 字节
+    void convertRows(const uint8_t* frame, int width, int height, int row_begin, int row_end, uint8_t* dst,
+                     size_t dst_stride) const {
+        for (int row = row_begin; row < row_end; ++row) {
+            convertRow(frame, width, height, row, dst + static_cast<size_t>(row - row_begin) * dst_stride);
+        }
+    }
+
+    /// convertScaled 支持的最大缩小倍数（row_downscale<6>）
+    static constexpr int kMaxScale = 64;
+
+    /// 缩小 factor 倍后的输出尺寸，不足一个块的右边和下边被丢弃
+    static int scaledSize(int size, int factor) { return size / factor; }
+
+    /**
+     * @brief 缩小与颜色转换一步完成：输出 (width/factor)×(height/factor) 的图像
+     * @param factor 缩小倍数，必须是 2 的幂且不超过 64；为 1 时等同于 convertRows
+     */
+    void convertScaled(const uint8_t* frame, int width, int height, int factor, uint8_t* dst,
+                       size_t dst_stride) const {
+        if (factor <= 1) {
+            convertRows(frame, width, height, 0, height, dst, dst_stride);
+            return;
+        }
+        int shift = 0;
+        while ((1 << shift) < factor) {
+            ++shift;
+        }
+        const int out_width = scaledSize(width, factor);
+        const int out_height = scaledSize(height, factor);
+        const nv21_detail::Coeffs& c = nv21_detail::coeffs(range_);
+        const bool rgb = order_ == PixelOrder::RGB;
+        const uint8_t* vu_plane = frame + static_cast<size_t>(width) * height;
+        auto rows = [&](auto row_fn) {
+            for (int row = 0; row < out_height; ++row) {
+                row_fn(frame + static_cast<size_t>(row) * factor * width,
+                       vu_plane + static_cast<size_t>(row) * (factor / 2) * width, width, out_width,
+                       dst + static_cast<size_t>(row) * dst_stride, c, rgb);
+            }
+        };
+        switch (shift) {
+            case 1: rows(nv21_detail::row_downscale<1>); break;
+            case 2: rows(nv21_detail::row_downscale<2>); break;
+            case 3: rows(nv21_detail::row_downscale<3>); break;
+            case 4: rows(nv21_detail::row_downscale<4>); break;
+            case 5: rows(nv21_detail::row_downscale<5>); break;
+            case 6: rows(nv21_detail::row_downscale<6>); break;
+            default: assert(!"convertScaled: factor must be a power of two up to kMaxScale"); break;
+        }
+    }
+
+private:
+    Nv21Kernel kernel_;
+    YuvRange range_;
+    PixelOrder order_;
+};
+
+#endif // NV21_CONVERT_H
@@ -0,0 +1,171 @@
+// NV21 转换单元测试：当前 CPU 支持的每个 SIMD 内核与标量内核逐字节比较（两种取值范围、两种通道顺序，
+// 宽度覆盖各内核的尾部处理），convertScaled 的每个缩小倍数与逐块求均值的参考实现比较，奇数尺寸被拒绝。
+// 不一致时返回非零
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include "nv21_convert.h"
+
+namespace {
+
+const int kWidths[] = {2, 14, 30, 34, 62, 66, 130, 258, 1922};
+const YuvRange kRanges[] = {YuvRange::Limited, YuvRange::Full};
+const PixelOrder kOrders[] = {PixelOrder::BGR, PixelOrder::RGB};
+
+const char* range_name(YuvRange range) {
+    return range == YuvRange::Full ? "full" : "limited";
+}
+
+const char* order_name(PixelOrder order) {
+    return order == PixelOrder::RGB ? "rgb" : "bgr";
+}
+
+/// 随机帧；约八分之一的字节取 0 / 255 等边界值，覆盖饱和与 Y < 16 的截断
+std::vector<uint8_t> make_frame(int width, int height, std::mt19937& rng) {
+    static const uint8_t kEdges[] = {0, 1, 15, 16, 128, 235, 240, 255};
+    std::vector<uint8_t> frame(static_cast<size_t>(width) * height * 3 / 2);
+    for (uint8_t& byte : frame) {
+        const uint32_t r = rng();
+        byte = (r & 7) == 0 ? kEdges[(r >> 3) & 7] : static_cast<uint8_t>(r >> 8);
+    }
+    return frame;
+}
+
+/// 比较两幅图像，报告第一个不同的字节
+bool same_image(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual, int width,
+                const std::string& what) {
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i] != actual[i]) {
+            const size_t pixel = i / 3;
+            std::cerr << "FAIL " << what << ": pixel (" << pixel % width << ", " << pixel / width << ") channel "
+                      << i % 3 << " expected " << int(expected[i]) << " got " << int(actual[i]) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// 各 SIMD 内核与标量内核的输出逐字节一致
+int test_kernels(std::mt19937& rng) {
+    int failures = 0;
+    const int height = 6;
+    for (int width : kWidths) {
+        const std::vector<uint8_t> frame = make_frame(width, height, rng);
+        const size_t stride = static_cast<size_t>(width) * 3;
+        for (YuvRange range : kRanges) {
+            for (PixelOrder order : kOrders) {
+                std::vector<uint8_t> expected(stride * height);
+                Nv21Converter(Nv21Kernel::Scalar, range, order)
+                    .convertRows(frame.data(), width, height, 0, height, expected.data(), stride);
+                for (Nv21Kernel kernel : {Nv21Kernel::SSE41, Nv21Kernel::AVX2, Nv21Kernel::AVX512}) {
+                    if (!nv21_kernel_supported(kernel)) {
+                        continue;
+                    }
+                    std::vector<uint8_t> actual(stride * height);
+                    Nv21Converter(kernel, range, order)
+                        .convertRows(frame.data(), width, height, 0, height, actual.data(), stride);
+                    const std::string what = std::string(nv21_kernel_name(kernel)) + " " + range_name(range) + " " +
+                                             order_name(order) + " width " + std::to_string(width);
+                    failures += !same_image(expected, actual, width, what);
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+/// convertScaled 的参考实现：逐块求亮度和色度的四舍五入均值，再按标量公式转换
+std::vector<uint8_t> reference_scaled(const std::vector<uint8_t>& frame, int width, int height, int factor,
+                                      YuvRange range, PixelOrder order) {
+    const int out_width = width / factor, out_height = height / factor;
+    const int half = factor / 2;
+    const uint8_t* vu = frame.data() + static_cast<size_t>(width) * height;
+    std::vector<uint8_t> image(static_cast<size_t>(out_width) * out_height * 3);
+    for (int oy = 0; oy < out_height; ++oy) {
+        for (int ox = 0; ox < out_width; ++ox) {
+            uint32_t y_sum = 0, v_sum = 0, u_sum = 0;
+            for (int dy = 0; dy < factor; ++dy) {
+                for (int dx = 0; dx < factor; ++dx) {
+                    y_sum += frame[static_cast<size_t>(oy * factor + dy) * width + ox * factor + dx];
+                }
+            }
+            for (int dy = 0; dy < half; ++dy) {
+                for (int dx = 0; dx < half; ++dx) {
+                    const size_t at = static_cast<size_t>(oy * half + dy) * width + (ox * half + dx) * 2;
+                    v_sum += vu[at];
+                    u_sum += vu[at + 1];
+                }
+            }
+            const uint32_t y_count = factor * factor, c_count = half * half;
+            nv21_detail::pixel_scalar(static_cast<int32_t>((y_sum + y_count / 2) / y_count),
+                                      static_cast<int32_t>((v_sum + c_count / 2) / c_count),
+                                      static_cast<int32_t>((u_sum + c_count / 2) / c_count),
+                                      image.data() + (static_cast<size_t>(oy) * out_width + ox) * 3,
+                                      nv21_detail::coeffs(range), order == PixelOrder::RGB);
+        }
+    }
+    return image;
+}
+
+/// convertScaled 的每个缩小倍数与参考实现一致；尺寸不是倍数的整数倍，覆盖被丢弃的右边和下边
+int test_scaled(std::mt19937& rng) {
+    int failures = 0;
+    for (int factor = 2; factor <= Nv21Converter::kMaxScale; factor *= 2) {
+        const int width = factor * 3 + 2, height = factor * 2 + 2;
+        const std::vector<uint8_t> frame = make_frame(width, height, rng);
+        const int out_width = Nv21Converter::scaledSize(width, factor);
+        for (YuvRange range : kRanges) {
+            for (PixelOrder order : kOrders) {
+                const std::vector<uint8_t> expected = reference_scaled(frame, width, height, factor, range, order);
+                std::vector<uint8_t> actual(expected.size());
+                Nv21Converter(Nv21Kernel::Scalar, range, order)
+                    .convertScaled(frame.data(), width, height, factor, actual.data(),
+                                   static_cast<size_t>(out_width) * 3);
+                const std::string what = "scale " + std::to_string(factor) + " " + range_name(range) + " " +
+                                         order_name(order);
+                failures += !same_image(expected, actual, out_width, what);
+            }
+        }
+    }
+    return failures;
+}
+
+/// 奇数宽或高的帧色度平面不完整，必须被 validSize 拒绝
+int test_sizes() {
+    int failures = 0;
+    const struct { int width, height; bool valid; } kCases[] = {
+        {2, 2, true}, {64, 48, true}, {1922, 6, true}, {0, 48, false}, {64, 0, false}, {-2, 2, false},
+        {63, 48, false}, {64, 47, false}, {33, 17, false}, {1, 1, false},
+    };
+    for (const auto& size : kCases) {
+        if (Nv21Converter::validSize(size.width, size.height) != size.valid) {
+            std::cerr << "FAIL validSize(" << size.width << ", " << size.height << ") should be "
+                      << (size.valid ? "true" : "false") << std::endl;
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(20240601);
+    std::cout << "Kernels:";
+    for (Nv21Kernel kernel : {Nv21Kernel::Scalar, Nv21Kernel::SSE41, Nv21Kernel::AVX2, Nv21Kernel::AVX512}) {
+        if (nv21_kernel_supported(kernel)) {
+            std::cout << " " << nv21_kernel_name(kernel);
+        }
+    }
+    std::cout << std::endl;
+
+    const int failures = test_sizes() + test_kernels(rng) + test_scaled(rng);
+    if (failures > 0) {
+        std::cerr << failures << " case(s) failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All NV21 conversion checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
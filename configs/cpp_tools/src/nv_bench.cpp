@@ -0,0 +1,394 @@
+// NV212PNG 端到端基准：生成合成 .nv21 语料（文件名 <...>_PW<宽>-PH<高>.nv21），按各模式运行 NV212PNG，
+// 汇总帧率、MB/s、各阶段忙碌 / 空闲 / 阻塞时间和峰值 RSS，写成 JSON，并可与保存的基线比较
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Resolution {
+    int width = 0;
+    int height = 0;
+
+    std::string text() const { return std::to_string(width) + "x" + std::to_string(height); }
+    size_t frameSize() const { return static_cast<size_t>(width) * height * 3 / 2; }
+};
+
+/// 一种运行模式：名字和附加给 NV212PNG 的参数
+struct Mode {
+    std::string name;
+    std::string args;
+};
+
+struct Options {
+    fs::path nv212png;
+    fs::path work_dir = fs::temp_directory_path() / "nv_bench";
+    fs::path output;
+    fs::path baseline;
+    std::vector<Resolution> resolutions;
+    std::vector<Mode> modes;
+    size_t frames = 100;
+    int repeat = 3;
+    double tolerance = 10;  ///< 允许的退化百分比
+};
+
+/// NV212PNG --stats-json 输出中的数值字段，按这个顺序写入结果
+const char* const kStatKeys[] = {
+    "frames", "frames_deduplicated", "input_bytes", "elapsed_s", "frames_per_s", "input_mb_per_s", "peak_rss_kb",
+    "budget_peak_bytes",
+    "reader_threads", "reader_busy_s", "reader_idle_s", "reader_blocked_s",
+    "converter_threads", "converter_busy_s", "converter_idle_s", "converter_blocked_s",
+    "writer_threads", "writer_busy_s", "writer_idle_s", "writer_blocked_s",
+};
+
+using Stats = std::map<std::string, double>;
+
+struct Result {
+    std::string mode;
+    std::string resolution;
+    std::string args;
+    Stats stats;
+};
+
+bool parse_resolution_arg(const std::string& text, Resolution& resolution) {
+    char tail = 0;
+    return std::sscanf(text.c_str(), "%dx%d%c", &resolution.width, &resolution.height, &tail) == 2 &&
+           resolution.width > 0 && resolution.height > 0 && resolution.width % 2 == 0 && resolution.height % 2 == 0;
+}
+
+/// 在一行 JSON 中查找 "key": 后的数值或字符串，只用于本工具和 NV212PNG 自己写出的扁平 JSON
+bool find_number(const std::string& text, const std::string& key, double& value) {
+    const size_t pos = text.find("\"" + key + "\":");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const char* start = text.c_str() + pos + key.size() + 3;
+    char* end = nullptr;
+    value = std::strtod(start, &end);
+    return end != start;
+}
+
+bool find_string(const std::string& text, const std::string& key, std::string& value) {
+    const std::string prefix = "\"" + key + "\": \"";
+    const size_t pos = text.find(prefix);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const size_t start = pos + prefix.size();
+    const size_t end = text.find('"', start);
+    if (end == std::string::npos) {
+        return false;
+    }
+    value = text.substr(start, end - start);
+    return true;
+}
+
+std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+std::string shell_quote(const std::string& text) {
+#ifdef _WIN32
+    return "\"" + text + "\"";
+#else
+    std::string out = "'";
+    for (char c : text) {
+        out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return out + "'";
+#endif
+}
+
+/// 合成第 index 帧：平滑渐变叠加噪声，接近相机画面的可压缩程度；每帧相位不同，运行中不会被去重
+void synthesize(const Resolution& resolution, size_t index, std::vector<uint8_t>& frame) {
+    const int w = resolution.width, h = resolution.height;
+    frame.resize(resolution.frameSize());
+    uint32_t seed = static_cast<uint32_t>(index) * 2654435761u + 12345;
+    const int phase = static_cast<int>(index * 7);
+    for (int y = 0; y < h; ++y) {
+        uint8_t* row = frame.data() + static_cast<size_t>(y) * w;
+        for (int x = 0; x < w; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            row[x] = static_cast<uint8_t>(16 + (x + y + phase) % (w + h) * 200 / (w + h) + (seed >> 29));
+        }
+    }
+    uint8_t* vu = frame.data() + static_cast<size_t>(w) * h;
+    for (int y = 0; y < h / 2; ++y) {
+        for (int x = 0; x < w; x += 2) {
+            vu[static_cast<size_t>(y) * w + x] = static_cast<uint8_t>(128 + (x - w / 2) * 40 / w);
+            vu[static_cast<size_t>(y) * w + x + 1] = static_cast<uint8_t>(128 + ((y + phase) % h - h / 4) * 80 / h);
+        }
+    }
+}
+
+/// 生成（或复用已有的）语料目录：frames 个单帧文件
+bool prepare_corpus(const fs::path& dir, const Resolution& resolution, size_t frames) {
+    const std::string suffix = "_PW" + std::to_string(resolution.width) + "-PH" + std::to_string(resolution.height) + ".nv21";
+    auto name = [&](size_t index) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "bench_%06zu", index);
+        return dir / (text + suffix);
+    };
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    size_t existing = 0;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        existing += entry.path().extension() == ".nv21";
+    }
+    if (existing == frames && fs::file_size(name(frames - 1), ec) == resolution.frameSize()) {
+        return true;
+    }
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().extension() == ".nv21") {
+            fs::remove(entry.path(), ec);
+        }
+    }
+    std::cout << "Generating " << frames << " frames of " << resolution.text() << " in " << dir << std::endl;
+    std::vector<uint8_t> frame;
+    for (size_t i = 0; i < frames; ++i) {
+        synthesize(resolution, i, frame);
+        std::ofstream out(name(i), std::ios::binary);
+        if (!out.write(reinterpret_cast<const char*>(frame.data()), static_cast<std::streamsize>(frame.size()))) {
+            std::cerr << "Failed to write: " << name(i) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// 运行一次 NV212PNG 并读取它写出的统计；每次都删除上次的输出，全部帧重新转换和写入
+bool run_once(const Options& options, const fs::path& corpus, const Mode& mode, Stats& stats) {
+    const fs::path stats_path = options.work_dir / "stats.json";
+    const fs::path log_path = options.work_dir / "run.log";
+    std::error_code ec;
+    fs::remove_all(corpus / "pngs", ec);
+    fs::remove(stats_path, ec);
+    const std::string command = shell_quote(options.nv212png.string()) + " " + shell_quote(corpus.string()) +
+                                " --force --stats-json " + shell_quote(stats_path.string()) + " " + mode.args +
+                                " > " + shell_quote(log_path.string()) + " 2>&1";
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "NV212PNG failed in mode " << mode.name << ", see " << log_path << std::endl;
+        return false;
+    }
+    std::ifstream in(stats_path);
+    std::stringstream text;
+    text << in.rdbuf();
+    for (const char* key : kStatKeys) {
+        double value = 0;
+        if (!find_number(text.str(), key, value)) {
+            std::cerr << "Missing \"" << key << "\" in " << stats_path << std::endl;
+            return false;
+        }
+        stats[key] = value;
+    }
+    return true;
+}
+
+/// 从 nv_bench 写出的结果文件读取各条结果（每条结果占一行）
+bool load_results(const fs::path& path, std::vector<Result>& results) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        Result result;
+        if (!find_string(line, "mode", result.mode) || !find_string(line, "resolution", result.resolution)) {
+            continue;
+        }
+        for (const char* key : kStatKeys) {
+            double value = 0;
+            if (find_number(line, key, value)) {
+                result.stats[key] = value;
+            }
+        }
+        results.push_back(std::move(result));
+    }
+    return true;
+}
+
+bool write_results(const fs::path& path, const Options& options, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << "{\n"
+        << "  \"tool\": \"nv_bench\",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"frames_per_run\": " << options.frames << ",\n"
+        << "  \"repeat\": " << options.repeat << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << "    {\"mode\": \"" << json_escape(result.mode) << "\", \"resolution\": \"" << result.resolution
+            << "\", \"args\": \"" << json_escape(result.args) << "\"";
+        for (const char* key : kStatKeys) {
+            char value[64];
+            std::snprintf(value, sizeof(value), "%.10g", result.stats.at(key));
+            out << ", \"" << key << "\": " << value;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+/// 与基线比较：帧率下降或峰值 RSS 增长超过 tolerance% 视为退化，返回退化的条数
+int compare(const std::vector<Result>& results, const std::vector<Result>& baseline, double tolerance) {
+    int regressions = 0;
+    std::printf("\n%-12s %-10s %12s %12s %8s %12s %12s %8s\n", "mode", "resolution", "fps", "base fps", "delta",
+                "RSS KB", "base RSS", "delta");
+    for (const Result& result : results) {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const Result& base) {
+            return base.mode == result.mode && base.resolution == result.resolution;
+        });
+        if (it == baseline.end() || !it->stats.count("frames_per_s") || !it->stats.count("peak_rss_kb")) {
+            std::printf("%-12s %-10s %12.1f %12s\n", result.mode.c_str(), result.resolution.c_str(),
+                        result.stats.at("frames_per_s"), "(no baseline)");
+            continue;
+        }
+        const double fps = result.stats.at("frames_per_s"), base_fps = it->stats.at("frames_per_s");
+        const double rss = result.stats.at("peak_rss_kb"), base_rss = it->stats.at("peak_rss_kb");
+        const double fps_delta = base_fps > 0 ? (fps / base_fps - 1) * 100 : 0;
+        const double rss_delta = base_rss > 0 ? (rss / base_rss - 1) * 100 : 0;
+        const bool regressed = fps_delta < -tolerance || rss_delta > tolerance;
+        regressions += regressed;
+        std::printf("%-12s %-10s %12.1f %12.1f %+7.1f%% %12.0f %12.0f %+7.1f%%%s\n", result.mode.c_str(),
+                    result.resolution.c_str(), fps, base_fps, fps_delta, rss, base_rss, rss_delta,
+                    regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--nv212png" && i + 1 < argc) {
+            options.nv212png = argv[++i];
+        } else if (arg == "--work-dir" && i + 1 < argc) {
+            options.work_dir = argv[++i];
+        } else if (arg == "--resolution" && i + 1 < argc) {
+            Resolution resolution;
+            usage_error |= !parse_resolution_arg(argv[++i], resolution);
+            options.resolutions.push_back(resolution);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.frames = std::strtoull(argv[++i], nullptr, 10);
+            usage_error |= options.frames == 0;
+        } else if (arg == "--mode" && i + 1 < argc) {
+            // <名字>=<NV212PNG 参数>，例如 "uring=--input uring --io-depth 64"
+            const std::string spec = argv[++i];
+            const size_t eq = spec.find('=');
+            usage_error |= eq == 0 || eq == std::string::npos;
+            options.modes.push_back({spec.substr(0, eq), eq == std::string::npos ? "" : spec.substr(eq + 1)});
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baseline = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = std::strtod(argv[++i], nullptr);
+            usage_error |= options.tolerance < 0;
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--nv212png <path>] [--work-dir <dir>] [--resolution WxH]... [--frames N]"
+                  << " [--mode name=args]... [--repeat N] [--output results.json]"
+                  << " [--baseline results.json] [--tolerance percent]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // 默认使用与本工具安装在同一目录的 NV212PNG
+    if (options.nv212png.empty()) {
+        const fs::path self(argv[0]);
+        options.nv212png = self.has_parent_path() ? self.parent_path() / "NV212PNG" : fs::path("NV212PNG");
+    }
+    if (options.resolutions.empty()) {
+        options.resolutions = {{1920, 1080}};
+    }
+    if (options.modes.empty()) {
+        options.modes = {{"default", ""}, {"mmap", "--input mmap"}, {"zlib", "--png-encoder zlib"}};
+#ifdef __linux__
+        options.modes.insert(options.modes.begin() + 2, {"uring", "--input uring"});
+#endif
+    }
+    if (options.output.empty()) {
+        options.output = options.work_dir / "results.json";
+    }
+
+    std::error_code ec;
+    fs::create_directories(options.work_dir, ec);
+    std::vector<Result> results;
+    for (const Resolution& resolution : options.resolutions) {
+        const fs::path corpus = options.work_dir / resolution.text();
+        if (!prepare_corpus(corpus, resolution, options.frames)) {
+            return EXIT_FAILURE;
+        }
+        for (const Mode& mode : options.modes) {
+            // 取帧率的中位数那一次的全部统计；语料在页缓存中，测的是流水线本身而不是冷盘读取
+            std::vector<Stats> runs;
+            for (int r = 0; r < options.repeat; ++r) {
+                Stats stats;
+                if (!run_once(options, corpus, mode, stats)) {
+                    return EXIT_FAILURE;
+                }
+                runs.push_back(std::move(stats));
+            }
+            std::sort(runs.begin(), runs.end(), [](const Stats& a, const Stats& b) {
+                return a.at("frames_per_s") < b.at("frames_per_s");
+            });
+            const Stats& median = runs[runs.size() / 2];
+            std::printf("%-12s %-10s %10.1f fps %9.1f MB/s %8.0f MB RSS | busy/idle/blocked s:"
+                        " R %.2f/%.2f/%.2f C %.2f/%.2f/%.2f W %.2f/%.2f/%.2f\n",
+                        mode.name.c_str(), resolution.text().c_str(), median.at("frames_per_s"),
+                        median.at("input_mb_per_s"), median.at("peak_rss_kb") / 1024,
+                        median.at("reader_busy_s"), median.at("reader_idle_s"), median.at("reader_blocked_s"),
+                        median.at("converter_busy_s"), median.at("converter_idle_s"), median.at("converter_blocked_s"),
+                        median.at("writer_busy_s"), median.at("writer_idle_s"), median.at("writer_blocked_s"));
+            std::fflush(stdout);
+            results.push_back({mode.name, resolution.text(), mode.args, median});
+        }
+        fs::remove_all(corpus / "pngs", ec);
+    }
+
+    if (!write_results(options.output, options, results)) {
+        std::cerr << "Failed to write: " << options.output << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Results written to " << options.output << std::endl;
+
+    if (!options.baseline.empty()) {
+        std::vector<Result> baseline;
+        if (!load_results(options.baseline, baseline)) {
+            std::cerr << "Failed to read baseline: " << options.baseline << std::endl;
+            return EXIT_FAILURE;
+        }
+        const int regressions = compare(results, baseline, options.tolerance);
+        if (regressions > 0) {
+            std::cout << regressions << " regression(s) beyond " << options.tolerance << "%" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+// 列出或解开 NV212PNG --archive 写出的归档（tar 或 pack）
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <set>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include "frame_archive.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool extract(std::istream& in, const ArchiveEntry& entry, const fs::path& output_dir) {
+    // 条目名来自归档文件，不允许写到输出目录之外
+    const fs::path name = fs::path(entry.name).lexically_normal();
+    if (name.empty() || name.is_absolute() || *name.begin() == "..") {
+        std::cerr << "Skipping unsafe entry name: " << entry.name << std::endl;
+        return false;
+    }
+    const fs::path path = output_dir / name;
+    fs::create_directories(path.parent_path());
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to open: " << path << std::endl;
+        return false;
+    }
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(entry.offset));
+    std::vector<char> buffer(1 << 20);
+    for (uint64_t left = entry.size; left > 0;) {
+        const size_t chunk = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+        if (!in.read(buffer.data(), static_cast<std::streamsize>(chunk)) || !out.write(buffer.data(), chunk)) {
+            std::cerr << "Failed to extract: " << entry.name << std::endl;
+            return false;
+        }
+        left -= chunk;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const std::string command = argc > 1 ? argv[1] : "";
+    if (!((command == "list" && argc == 3) || (command == "extract" && argc >= 4))) {
+        std::cerr << "Usage: " << argv[0] << " list <archive>\n"
+                  << "       " << argv[0] << " extract <archive> <output_dir> [name...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[2], std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open: " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<ArchiveEntry> entries;
+    ArchiveFormat format;
+    std::string error;
+    if (!read_archive_index(in, entries, format, error)) {
+        std::cerr << argv[2] << ": " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (command == "list") {
+        uint64_t total = 0;
+        for (const ArchiveEntry& entry : entries) {
+            std::printf("%12llu  %s\n", static_cast<unsigned long long>(entry.size), entry.name.c_str());
+            total += entry.size;
+        }
+        std::printf("%zu entries, %llu bytes (%s)\n", entries.size(), static_cast<unsigned long long>(total),
+                    format == ArchiveFormat::Tar ? "tar" : "pack");
+        return EXIT_SUCCESS;
+    }
+
+    // 只给出部分名字时只解开这些条目；pack 格式按偏移表直接定位，不扫描其他条目
+    const std::set<std::string> wanted(argv + 4, argv + argc);
+    std::set<std::string> found;
+    const fs::path output_dir(argv[3]);
+    size_t extracted = 0;
+    bool ok = true;
+    for (const ArchiveEntry& entry : entries) {
+        if (!wanted.empty()) {
+            if (!wanted.count(entry.name)) {
+                continue;
+            }
+            found.insert(entry.name);
+        }
+        if (extract(in, entry, output_dir)) {
+            ++extracted;
+        } else {
+            ok = false;
+        }
+    }
+    for (const std::string& name : wanted) {
+        if (found.count(name)) {
+            continue;
+        }
+        std::cerr << "Not in archive: " << name << std::endl;
+        ok = false;
+    }
+    std::cout << "Extracted " << extracted << " entries to " << output_dir << std::endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,198 @@
+// PNG 编码基准：对同一帧比较 OpenCV 默认参数与内置 zlib 编码器在各压缩级别、过滤方式、
+// 线程数下的吞吐 (MB/s，按未压缩 RGB 字节计) 和压缩率，并解码校验输出
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <opencv2/opencv.hpp>
+#include "nv21_convert.h"
+#include "png_writer.h"
+
+namespace {
+
+struct Frame {
+    int width = 1920;
+    int height = 1080;
+    std::vector<uint8_t> nv21;
+};
+
+/// 合成一帧：平滑渐变叠加少量噪声，接近相机画面的可压缩程度
+void synthesize(Frame& frame) {
+    const int w = frame.width, h = frame.height;
+    frame.nv21.resize(static_cast<size_t>(w) * h * 3 / 2);
+    uint32_t seed = 12345;
+    auto noise = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<int>(seed >> 29);
+    };
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            frame.nv21[static_cast<size_t>(y) * w + x] = static_cast<uint8_t>(16 + (x + y) * 200 / (w + h) + noise());
+        }
+    }
+    uint8_t* vu = frame.nv21.data() + static_cast<size_t>(w) * h;
+    for (int y = 0; y < h / 2; ++y) {
+        for (int x = 0; x < w; x += 2) {
+            vu[static_cast<size_t>(y) * w + x] = static_cast<uint8_t>(128 + (x - w / 2) * 40 / w);
+            vu[static_cast<size_t>(y) * w + x + 1] = static_cast<uint8_t>(128 + (y - h / 4) * 80 / h);
+        }
+    }
+}
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+/// 解码 8 位 RGB PNG 并与原图比较
+bool verify_png(const std::vector<uint8_t>& png, const std::vector<uint8_t>& rgb, int width, int height) {
+    std::vector<uint8_t> zdata;
+    for (size_t pos = 8; pos + 12 <= png.size();) {
+        uint32_t length = read_be32(&png[pos]);
+        if (pos + 12 + length > png.size()) {
+            return false;
+        }
+        const uint8_t* type = &png[pos + 4];
+        if (crc32(0L, type, length + 4) != read_be32(&png[pos + 8 + length])) {
+            return false;
+        }
+        if (std::memcmp(type, "IDAT", 4) == 0) {
+            zdata.insert(zdata.end(), type + 4, type + 4 + length);
+        }
+        pos += 12 + length;
+    }
+    const size_t row_bytes = static_cast<size_t>(width) * 3;
+    std::vector<uint8_t> raw(height * (row_bytes + 1));
+    uLongf raw_size = raw.size();
+    if (uncompress(raw.data(), &raw_size, zdata.data(), zdata.size()) != Z_OK || raw_size != raw.size()) {
+        return false;
+    }
+    std::vector<uint8_t> prev(row_bytes, 0), cur(row_bytes);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* line = &raw[y * (row_bytes + 1)];
+        for (size_t i = 0; i < row_bytes; ++i) {
+            int a = i >= 3 ? cur[i - 3] : 0, b = prev[i], c = i >= 3 ? prev[i - 3] : 0;
+            int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            int predictor[5] = {0, a, b, (a + b) >> 1, pa <= pb && pa <= pc ? a : pb <= pc ? b : c};
+            if (line[0] > 4) {
+                return false;
+            }
+            cur[i] = static_cast<uint8_t>(line[1 + i] + predictor[line[0]]);
+        }
+        if (std::memcmp(cur.data(), &rgb[y * row_bytes], row_bytes) != 0) {
+            return false;
+        }
+        std::swap(prev, cur);
+    }
+    return true;
+}
+
+/// 重复 repeat 次，返回最短的一次耗时 (秒)
+template <typename Fn>
+double best_time(int repeat, Fn&& fn) {
+    double best = 1e30;
+    for (int i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void report(const std::string& name, double seconds, size_t raw_bytes, size_t png_bytes, const char* check) {
+    std::printf("%-34s %9.1f MB/s %8.3f  %s\n", name.c_str(), raw_bytes / seconds / 1e6,
+                static_cast<double>(png_bytes) / raw_bytes, check);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Frame frame;
+    const char* input = nullptr;
+    int repeat = 5;
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            usage_error |= std::sscanf(argv[++i], "%dx%d", &frame.width, &frame.height) != 2 ||
+                           frame.width <= 0 || frame.height <= 0 || frame.width % 2 || frame.height % 2;
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            max_threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (!input && arg.rfind("--", 0) != 0) {
+            input = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error) {
+        std::cerr << "Usage: " << argv[0] << " [--size WxH] [--repeat N] [--threads N] [frame.nv21]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (input) {
+        std::ifstream file(input, std::ios::binary);
+        frame.nv21.resize(static_cast<size_t>(frame.width) * frame.height * 3 / 2);
+        if (!file.read(reinterpret_cast<char*>(frame.nv21.data()), frame.nv21.size())) {
+            std::cerr << "Cannot read " << frame.width << "x" << frame.height << " NV21 frame from " << input
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    } else {
+        synthesize(frame);
+    }
+
+    const int w = frame.width, h = frame.height;
+    const size_t raw_bytes = static_cast<size_t>(w) * h * 3;
+    std::vector<uint8_t> rgb(raw_bytes), bgr(raw_bytes);
+    Nv21Converter(nv21_best_kernel(), YuvRange::Limited, PixelOrder::RGB)
+        .convertRows(frame.nv21.data(), w, h, 0, h, rgb.data(), static_cast<size_t>(w) * 3);
+    Nv21Converter(nv21_best_kernel(), YuvRange::Limited, PixelOrder::BGR)
+        .convertRows(frame.nv21.data(), w, h, 0, h, bgr.data(), static_cast<size_t>(w) * 3);
+
+    std::printf("Frame %dx%d (%s), %zu raw bytes, best of %d\n", w, h, input ? input : "synthetic", raw_bytes,
+                repeat);
+    std::printf("%-34s %14s %8s\n", "setting", "throughput", "ratio");
+
+    {
+        cv::Mat image(h, w, CV_8UC3, bgr.data());
+        std::vector<uint8_t> encoded;
+        double seconds = best_time(repeat, [&]() { cv::imencode(".png", image, encoded); });
+        report("opencv default", seconds, raw_bytes, encoded.size(), "");
+    }
+
+    std::vector<unsigned> thread_counts = {1};
+    if (max_threads > 1) {
+        thread_counts.push_back(max_threads);
+    }
+    bool all_ok = true;
+    for (int level : {0, 1, 3, 6, 9}) {
+        for (PngFilter filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Adaptive}) {
+            for (unsigned threads : thread_counts) {
+                PngOptions options;
+                options.level = level;
+                options.filter = filter;
+                options.threads = threads;
+                PngEncoder encoder(options);
+                std::vector<uint8_t> encoded;
+                std::string error;
+                bool ok = true;
+                double seconds = best_time(repeat, [&]() {
+                    ok = ok && encoder.encode(rgb.data(), w, h, static_cast<size_t>(w) * 3, encoded, error);
+                });
+                ok = ok && verify_png(encoded, rgb, w, h);
+                all_ok = all_ok && ok;
+                std::string name = "zlib level=" + std::to_string(level) + " filter=" + png_filter_name(filter) +
+                                   " threads=" + std::to_string(threads);
+                report(name, seconds, raw_bytes, encoded.size(), ok ? "ok" : "VERIFY FAILED");
+            }
+        }
+    }
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
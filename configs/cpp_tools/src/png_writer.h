@@ -0,0 +1,459 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+#include "systrace.h"
+
+/// PNG 行过滤方式
+enum class PngFilter {
+    None,       ///< 不过滤，最快
+    Sub,        ///< 减去左侧像素
+    Up,         ///< 减去上一行
+    Adaptive,   ///< 每行在 None/Sub/Up/Average/Paeth 中选绝对值和最小的一种（libpng 默认策略）
+};
+
+inline const char* png_filter_name(PngFilter filter) {
+    switch (filter) {
+        case PngFilter::None: return "none";
+        case PngFilter::Sub: return "sub";
+        case PngFilter::Up: return "up";
+        default: return "adaptive";
+    }
+}
+
+inline bool parse_png_filter(const std::string& name, PngFilter& filter) {
+    for (PngFilter candidate : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Adaptive}) {
+        if (name == png_filter_name(candidate)) {
+            filter = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// PNG 编码参数
+struct PngOptions {
+    int level = 6;                          ///< zlib 压缩级别 0..9
+    PngFilter filter = PngFilter::Adaptive;
+    unsigned threads = 1;                   ///< 单帧并行压缩的线程数
+    size_t chunk_bytes = 256 << 10;         ///< 并行压缩时每块的未压缩字节数（按整行切分）
+};
+
+/**
+ * @brief PngEncoder 的常驻辅助线程
+ *
+ * 线程在第一次并行编码时创建，之后每帧的过滤和压缩都交给同一组线程，
+ * 不再逐帧创建和销毁线程；线程名只设置一次，跟踪中每个辅助线程只有一条轨道。
+ */
+class PngHelperThreads {
+public:
+    explicit PngHelperThreads(size_t count) {
+        static std::atomic<unsigned> next_id{0};
+        for (size_t i = 0; i < count; ++i) {
+            const unsigned id = next_id++;
+            threads_.emplace_back([this, i, id]() {
+                TRACE_SET_THREAD_NAME("PngDeflateThread-" + std::to_string(id));
+                loop(i);
+            });
+        }
+    }
+
+    ~PngHelperThreads() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    PngHelperThreads(const PngHelperThreads&) = delete;
+    PngHelperThreads& operator=(const PngHelperThreads&) = delete;
+
+    size_t size() const { return threads_.size(); }
+
+    /// 在调用线程和前 helpers 个辅助线程上同时运行 fn()，全部返回后才返回
+    template <typename Fn>
+    void run(size_t helpers, Fn& fn) {
+        helpers = std::min(helpers, threads_.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = [](void* context) { (*static_cast<Fn*>(context))(); };
+            context_ = &fn;
+            wanted_ = helpers;
+            running_ = helpers;
+            ++generation_;
+        }
+        wake_.notify_all();
+        fn();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return running_ == 0; });
+    }
+
+private:
+    void loop(size_t index) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+            if (index >= wanted_) {
+                continue;
+            }
+            void (*job)(void*) = job_;
+            void* context = context_;
+            lock.unlock();
+            job(context);
+            lock.lock();
+            if (--running_ == 0) {
+                done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    void (*job_)(void*) = nullptr;
+    void* context_ = nullptr;
+    size_t wanted_ = 0;                 ///< 本轮参与的辅助线程数（下标小于它的线程）
+    size_t running_ = 0;                ///< 本轮尚未完成的辅助线程数
+    uint64_t generation_ = 0;           ///< 每轮加一，辅助线程据此发现新任务
+    bool stop_ = false;
+};
+
+/**
+ * @brief 8 位 RGB PNG 编码器，基于 zlib
+ *
+ * threads > 1 时按 pigz 的方式并行压缩：过滤后的图像数据按行切成若干块，每块单独做原始 deflate，
+ * 以前一块末尾 32KB 作为预设字典，除最后一块外以 Z_SYNC_FLUSH 结束并字节对齐，
+ * 拼接后就是一个完整的 deflate 流；adler32 逐块计算后用 adler32_combine 合并。
+ * 输出是标准 PNG，压缩率只比单线程略低。
+ *
+ * 编码器保存过滤和压缩用的临时缓冲区和 threads-1 个常驻辅助线程，每个线程使用自己的实例即可避免逐帧分配。
+ */
+class PngEncoder {
+public:
+    explicit PngEncoder(PngOptions options = PngOptions()) : options_(options) {
+        options_.level = std::clamp(options_.level, 0, 9);
+        options_.threads = std::max(1u, options_.threads);
+        options_.chunk_bytes = std::max<size_t>(options_.chunk_bytes, 64 << 10);
+    }
+
+    const PngOptions& options() const { return options_; }
+
+    /**
+     * @brief 编码一帧 RGB 图像
+     * @param rgb 第一行像素，相邻两行相距 stride 字节
+     * @param out 输出的 PNG 文件内容（覆盖原有内容）
+     * @return 图像为空或 zlib 出错时返回 false
+     */
+    bool encode(const uint8_t* rgb, int width, int height, size_t stride, std::vector<uint8_t>& out,
+                std::string& error) {
+        if (width <= 0 || height <= 0) {
+            error = "empty image";
+            return false;
+        }
+        TRACE_SCOPE_ARGS(io, "PngEncode", TRACE_ARG("level", options_.level),
+                         TRACE_ARG("threads", options_.threads));
+        const size_t row_bytes = static_cast<size_t>(width) * 3;
+        const size_t line_bytes = row_bytes + 1;    // 每行前有一个过滤类型字节
+        const size_t rows = static_cast<size_t>(height);
+
+        // 按整行切块，单线程时只有一块，结果与普通 zlib 压缩相同
+        size_t rows_per_chunk = rows;
+        if (options_.threads > 1) {
+            rows_per_chunk = std::max<size_t>(1, options_.chunk_bytes / line_bytes);
+        }
+        const size_t chunk_count = (rows + rows_per_chunk - 1) / rows_per_chunk;
+        filtered_.resize(rows * line_bytes);
+        chunks_.resize(chunk_count);
+
+        parallel_for(chunk_count, [&](size_t i) {
+            size_t begin = i * rows_per_chunk;
+            size_t end = std::min(rows, begin + rows_per_chunk);
+            TRACE_SCOPE_ARGS(convert, "PngFilter", TRACE_ARG("rows", end - begin));
+            for (size_t y = begin; y < end; ++y) {
+                filterRow(rgb + y * stride, y > 0 ? rgb + (y - 1) * stride : nullptr, row_bytes,
+                          &filtered_[y * line_bytes]);
+            }
+        });
+
+        std::atomic<bool> failed{false};
+        parallel_for(chunk_count, [&](size_t i) {
+            size_t begin = i * rows_per_chunk * line_bytes;
+            size_t end = std::min(rows, (i + 1) * rows_per_chunk) * line_bytes;
+            if (!deflateChunk(i, begin, end, i + 1 == chunk_count)) {
+                failed = true;
+            }
+        });
+        if (failed) {
+            error = "deflate failed";
+            return false;
+        }
+
+        out.clear();
+        static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        out.insert(out.end(), kSignature, kSignature + 8);
+
+        uint8_t ihdr[13];
+        putBigEndian(ihdr, static_cast<uint32_t>(width));
+        putBigEndian(ihdr + 4, static_cast<uint32_t>(height));
+        ihdr[8] = 8;        // 位深
+        ihdr[9] = 2;        // 颜色类型：RGB
+        ihdr[10] = 0;       // 压缩方法：deflate
+        ihdr[11] = 0;       // 过滤方法：自适应过滤
+        ihdr[12] = 0;       // 不隔行
+        appendChunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+        // zlib 流：2 字节头 + 各块 deflate 数据 + adler32，每块放进一个 IDAT
+        uint8_t* header = chunks_.front().data.data();
+        header[0] = 0x78;       // deflate，32KB 窗口
+        header[1] = static_cast<uint8_t>(zlibLevelFlag() << 6);
+        header[1] = static_cast<uint8_t>(header[1] + 31 - (header[0] * 256 + header[1]) % 31);
+        uLong adler = adler32(0L, Z_NULL, 0);
+        for (const Chunk& chunk : chunks_) {
+            adler = adler32_combine(adler, chunk.adler, static_cast<z_off_t>(chunk.input_bytes));
+        }
+        uint8_t trailer[4];
+        putBigEndian(trailer, static_cast<uint32_t>(adler));
+        std::vector<uint8_t>& last = chunks_.back().data;
+        last.insert(last.end(), trailer, trailer + 4);
+
+        for (const Chunk& chunk : chunks_) {
+            appendChunk(out, "IDAT", chunk.data.data(), chunk.data.size());
+        }
+        appendChunk(out, "IEND", nullptr, 0);
+        return true;
+    }
+
+    /// 编码并写入文件
+    bool write(const std::filesystem::path& path, const uint8_t* rgb, int width, int height, size_t stride,
+               std::string& error) {
+        if (!encode(rgb, width, height, stride, encoded_, error)) {
+            return false;
+        }
+        TRACE_SCOPE_ARGS(io, "PngFileWrite", TRACE_ARG("bytes", encoded_.size()));
+        // write 只写入流缓冲区，磁盘满等错误要到 close 刷新时才出现，必须检查 close 之后的状态
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(encoded_.data()), encoded_.size());
+        file.close();
+        if (!file) {
+            error = "cannot write file";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct StreamDeleter {
+        void operator()(z_stream* stream) const {
+            deflateEnd(stream);
+            delete stream;
+        }
+    };
+
+    struct Chunk {
+        std::unique_ptr<z_stream, StreamDeleter> stream;   ///< 跨帧复用，避免每帧重新分配 deflate 状态
+        std::vector<uint8_t> data;      ///< deflate 数据，第一块前有 zlib 头，最后一块后有 adler32
+        uLong adler = 0;                ///< 本块未压缩数据的 adler32
+        size_t input_bytes = 0;
+    };
+
+    static constexpr size_t kWindowSize = 32768;
+
+    /// 在当前线程和最多 threads-1 个辅助线程上执行 fn(0..count-1)
+    template <typename Fn>
+    void parallel_for(size_t count, Fn&& fn) {
+        size_t workers = std::min<size_t>(options_.threads, count);
+        if (workers <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+            return;
+        }
+        if (!helpers_) {
+            helpers_ = std::make_unique<PngHelperThreads>(options_.threads - 1);
+        }
+        std::atomic<size_t> next{0};
+        auto run = [&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                fn(i);
+            }
+        };
+        helpers_->run(workers - 1, run);
+    }
+
+    bool deflateChunk(size_t index, size_t begin, size_t end, bool last) {
+        TRACE_SCOPE_ARGS(io, "Deflate", TRACE_ARG("chunk", index), TRACE_ARG("bytes", end - begin));
+        Chunk& chunk = chunks_[index];
+        chunk.input_bytes = end - begin;
+        chunk.adler = adler32(adler32(0L, Z_NULL, 0), filtered_.data() + begin, static_cast<uInt>(end - begin));
+
+        if (!chunk.stream) {
+            std::unique_ptr<z_stream, StreamDeleter> stream(new z_stream());
+            if (deflateInit2(stream.get(), options_.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                delete stream.release();    // 初始化失败时不能调用 deflateEnd
+                return false;
+            }
+            chunk.stream = std::move(stream);
+        } else if (deflateReset(chunk.stream.get()) != Z_OK) {
+            return false;
+        }
+        z_stream& stream = *chunk.stream;
+        if (begin > 0) {
+            // 以前一块末尾作为字典，跨块的匹配仍然有效，压缩率接近单线程
+            size_t dict = std::min(begin, kWindowSize);
+            deflateSetDictionary(&stream, filtered_.data() + begin - dict, static_cast<uInt>(dict));
+        }
+        // 第一块前留出 zlib 头；为同步刷新的空 stored 块和最后的 adler32 预留余量
+        const size_t prefix = index == 0 ? 2 : 0;
+        chunk.data.resize(prefix + deflateBound(&stream, end - begin) + 16);
+        stream.next_in = filtered_.data() + begin;
+        stream.avail_in = static_cast<uInt>(end - begin);
+        stream.next_out = chunk.data.data() + prefix;
+        stream.avail_out = static_cast<uInt>(chunk.data.size() - prefix);
+        int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        bool ok = last ? ret == Z_STREAM_END : ret == Z_OK && stream.avail_in == 0;
+        chunk.data.resize(prefix + stream.total_out);
+        return ok;
+    }
+
+    /// zlib 头中的 FLEVEL 字段
+    int zlibLevelFlag() const {
+        if (options_.level <= 1) return 0;
+        if (options_.level <= 5) return 1;
+        if (options_.level == 6) return 2;
+        return 3;
+    }
+
+    static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+        int pa = std::abs(b - c);   // |p - a|，p = a + b - c
+        int pb = std::abs(a - c);
+        int pc = std::abs(a + b - 2 * c);
+        int ab = pa <= pb ? a : b;
+        int best = std::min(pa, pb);
+        return static_cast<uint8_t>(best <= pc ? ab : c);
+    }
+
+    /// 用过滤类型 type 过滤一行，out[0] 为类型字节；prev 为上一行（第一行时为全零行）
+    static void applyFilter(int type, const uint8_t* row, const uint8_t* prev, size_t bytes, uint8_t* out) {
+        constexpr size_t bpp = 3;
+        out[0] = static_cast<uint8_t>(type);
+        uint8_t* dst = out + 1;
+        const size_t head = std::min(bpp, bytes);   // 第一个像素没有左侧像素，单独处理，主循环无分支以便向量化
+        switch (type) {
+            case 0:
+                std::memcpy(dst, row, bytes);
+                break;
+            case 1:
+                std::memcpy(dst, row, head);
+                for (size_t i = bpp; i < bytes; ++i) {
+                    dst[i] = static_cast<uint8_t>(row[i] - row[i - bpp]);
+                }
+                break;
+            case 2:
+                for (size_t i = 0; i < bytes; ++i) {
+                    dst[i] = static_cast<uint8_t>(row[i] - prev[i]);
+                }
+                break;
+            case 3:
+                for (size_t i = 0; i < head; ++i) {
+                    dst[i] = static_cast<uint8_t>(row[i] - (prev[i] >> 1));
+                }
+                for (size_t i = bpp; i < bytes; ++i) {
+                    dst[i] = static_cast<uint8_t>(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+                }
+                break;
+            default:
+                for (size_t i = 0; i < head; ++i) {
+                    dst[i] = static_cast<uint8_t>(row[i] - prev[i]);   // 左侧和左上为 0 时 Paeth 取上方
+                }
+                for (size_t i = bpp; i < bytes; ++i) {
+                    dst[i] = static_cast<uint8_t>(row[i] - paeth(row[i - bpp], prev[i], prev[i - bpp]));
+                }
+                break;
+        }
+    }
+
+    void filterRow(const uint8_t* row, const uint8_t* prev, size_t bytes, uint8_t* out) const {
+        thread_local std::vector<uint8_t> zero_row;
+        if (!prev) {
+            zero_row.assign(bytes, 0);
+            prev = zero_row.data();
+        }
+        switch (options_.filter) {
+            case PngFilter::None: applyFilter(0, row, prev, bytes, out); return;
+            case PngFilter::Sub: applyFilter(1, row, prev, bytes, out); return;
+            case PngFilter::Up: applyFilter(2, row, prev, bytes, out); return;
+            default: break;
+        }
+        // 自适应：把每种过滤结果视为有符号字节，取绝对值之和最小的
+        thread_local std::vector<uint8_t> candidate;
+        candidate.resize(bytes + 1);
+        uint64_t best_cost = UINT64_MAX;
+        for (int type = 0; type <= 4; ++type) {
+            uint8_t* target = type == 0 ? out : candidate.data();
+            applyFilter(type, row, prev, bytes, target);
+            uint64_t cost = 0;
+            for (size_t i = 1; i <= bytes; ++i) {
+                cost += static_cast<uint64_t>(std::abs(static_cast<int8_t>(target[i])));
+            }
+            if (cost < best_cost) {
+                best_cost = cost;
+                if (target != out) {
+                    std::memcpy(out, target, bytes + 1);
+                }
+            }
+        }
+    }
+
+    static void putBigEndian(uint8_t* out, uint32_t value) {
+        out[0] = static_cast<uint8_t>(value >> 24);
+        out[1] = static_cast<uint8_t>(value >> 16);
+        out[2] = static_cast<uint8_t>(value >> 8);
+        out[3] = static_cast<uint8_t>(value);
+    }
+
+    static void appendChunk(std::vector<uint8_t>& out, const char type[4], const uint8_t* data, size_t size) {
+        uint8_t length[4];
+        putBigEndian(length, static_cast<uint32_t>(size));
+        out.insert(out.end(), length, length + 4);
+        size_t type_pos = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0) {
+            out.insert(out.end(), data, data + size);
+        }
+        uLong crc = crc32(0L, out.data() + type_pos, static_cast<uInt>(size + 4));
+        uint8_t crc_bytes[4];
+        putBigEndian(crc_bytes, static_cast<uint32_t>(crc));
+        out.insert(out.end(), crc_bytes, crc_bytes + 4);
+    }
+
+    PngOptions options_;
+    std::vector<uint8_t> filtered_;     ///< 过滤后的图像数据（每行带类型字节）
+    std::vector<Chunk> chunks_;
+    std::vector<uint8_t> encoded_;
+    std::unique_ptr<PngHelperThreads> helpers_;     ///< 第一次并行编码时创建
+};
+
+#endif // PNG_WRITER_H
@@ -0,0 +1,123 @@
+// 队列基准：在不同生产者 / 消费者数下比较 LockedQueue（互斥锁 + 条件变量）与
+// ConcurrentQueue（无锁环形队列 + 忙等后 futex）的吞吐，并校验每项恰好被取出一次
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include "concurrent_queue.h"
+
+namespace {
+
+struct Options {
+    size_t items = 1000000;
+    size_t capacity = 16;
+    int repeat = 3;
+};
+
+/// 与流水线中队列项相近：可移动、带一段堆内存
+struct Item {
+    uint64_t id = 0;
+    std::string name;
+};
+
+/// 运行一次：producers 个线程共推入 items 项，consumers 个线程取完，返回耗时（秒）；校验失败返回负数
+template <typename Queue>
+double run(Queue& queue, size_t producers, size_t consumers, size_t items) {
+    std::atomic<uint64_t> sum{0};
+    std::atomic<size_t> count{0};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&]() {
+            Item item;
+            uint64_t local_sum = 0;
+            size_t local_count = 0;
+            while (queue.pop(item)) {
+                local_sum += item.id;
+                ++local_count;
+            }
+            sum += local_sum;
+            count += local_count;
+        });
+    }
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (size_t i = p; i < items; i += producers) {
+                queue.push(Item{i + 1, "frame"});
+            }
+            queue.producerDone();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t expected = static_cast<uint64_t>(items) * (items + 1) / 2;
+    return count == items && sum == expected ? seconds : -1.0;
+}
+
+template <typename Make>
+void report(const char* name, size_t producers, size_t consumers, const Options& options, Make make) {
+    double best = 1e30;
+    bool ok = true;
+    for (int i = 0; i < options.repeat; ++i) {
+        auto queue = make();
+        double seconds = run(*queue, producers, consumers, options.items);
+        ok = ok && seconds >= 0;
+        if (seconds >= 0) {
+            best = std::min(best, seconds);
+        }
+    }
+    std::printf("%zu:%-3zu %-16s %10.2f Mitems/s  %s\n", producers, consumers, name,
+                ok ? options.items / best / 1e6 : 0.0, ok ? "ok" : "CHECK FAILED");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::vector<std::pair<size_t, size_t>> shapes;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--items" && i + 1 < argc) {
+            options.items = std::strtoull(argv[++i], nullptr, 10);
+            usage_error |= options.items == 0;
+        } else if (arg == "--capacity" && i + 1 < argc) {
+            options.capacity = std::strtoull(argv[++i], nullptr, 10);
+            usage_error |= options.capacity == 0;
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            size_t producers = 0, consumers = 0;
+            usage_error |= std::sscanf(argv[++i], "%zu:%zu", &producers, &consumers) != 2 || !producers || !consumers;
+            shapes.emplace_back(producers, consumers);
+        } else {
+            usage_error = true;
+        }
+    }
+    if (usage_error) {
+        std::cerr << "Usage: " << argv[0] << " [--items N] [--capacity N] [--repeat N] [--threads P:C]..."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (shapes.empty()) {
+        shapes = {{1, 1}, {1, 4}, {4, 1}, {4, 4}};
+    }
+
+    std::printf("%zu items, capacity %zu, best of %d, %u hardware threads\n", options.items, options.capacity,
+                options.repeat, std::thread::hardware_concurrency());
+    for (const auto& [producers, consumers] : shapes) {
+        report("locked", producers, consumers, options, [&]() {
+            return std::make_unique<LockedQueue<Item>>(producers, options.capacity);
+        });
+        report(producers == 1 && consumers == 1 ? "ring (spsc)" : "ring (mpmc)", producers, consumers, options, [&]() {
+            return std::make_unique<ConcurrentQueue<Item>>(producers, consumers, options.capacity);
+        });
+    }
+    return EXIT_SUCCESS;
+}
@@ -16,7 +16,19 @@
 #include <iostream>
 #include <memory>
 #include <cstring>
+#include <cstdint>
+#include <type_traits>
 #include <unordered_map>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include "systrace_format.h"
+#include "systrace_clock.h"
+#include "systrace_histogram.h"
+#include "systrace_perf.h"
+#include "systrace_flight.h"
+#include "systrace_alloc.h"
 
 namespace fs = std::filesystem;
 
@@ -24,14 +36,203 @@ namespace fs = std::filesystem;
  * @brief 跨平台性能分析工具，支持线程名称和内存追踪（兼容Cygwin）
  */
 class Systrace {
+    struct Chunk;
+
 public:
-    /// 跟踪事件类型
-    struct Event {
-        std::string name;       ///< 事件名称
-        char type;              ///< 事件类型 (B, E, I, C)
-        uint32_t tid;           ///< 线程ID
-        std::chrono::high_resolution_clock::time_point ts; ///< 时间戳
-        std::string args;       ///< 额外参数 (JSON 格式)
+    static constexpr size_t kMaxArgs = kTraceMaxArgs;
+    static constexpr size_t kShortStringSize = kTraceShortStringSize;
+
+    /// 宏中使用的类别名，例如 TRACE_SCOPE(io, "ReadFile")
+    struct Category {
+        static constexpr uint16_t io = kTraceCatIo;
+        static constexpr uint16_t convert = kTraceCatConvert;
+        static constexpr uint16_t queue = kTraceCatQueue;
+        static constexpr uint16_t mem = kTraceCatMem;
+        static constexpr uint16_t pipeline = kTraceCatPipeline;
+    };
+
+    using ArgType = TraceArgType;
+    using Arg = TraceArg;
+    using Event = TraceEvent;
+
+    /// 记录模式，按位组合
+    enum Mode : uint32_t {
+        kModeRecord = 1u << 0,      ///< 记录完整事件流
+        kModeSummary = 1u << 1,     ///< 只把作用域时长折叠进直方图，结束时输出统计表
+    };
+
+    static constexpr size_t kChunkEvents = 4096;                ///< 每块事件数
+    static constexpr size_t kMaxSummaryNames = 1024;            ///< 统计模式下每线程最多跟踪的名称数
+    static constexpr size_t kDefaultStreamMemory = 64u << 20;   ///< 流式模式默认内存上限
+    static constexpr std::chrono::milliseconds kFlushInterval{50}; ///< 后台刷新周期
+
+    /**
+     * @brief 线程私有的事件缓冲区
+     *
+     * 由定长块组成单向链表，只有所属线程写入，写入路径不加锁。
+     * 块内计数以 release 语义发布，导出线程以 acquire 语义读取，
+     * 因此导出和后台刷新线程可以在不阻塞写入线程的情况下读取已发布的事件。
+     * 飞行记录模式下不使用块，事件直接写入映射文件中的环形缓冲区。
+     */
+    class ThreadBuffer {
+    public:
+        ThreadBuffer(uint32_t tid, Chunk* first) : tid_(tid), head_(first), tail_(first) {}
+
+        /// 飞行记录模式：ring 为空表示没有分配到槽，事件全部丢弃
+        ThreadBuffer(uint32_t tid, const TraceFlightRing* ring)
+            : tid_(tid), head_(nullptr), tail_(nullptr), storage_(ring ? Storage::Ring : Storage::Discard) {
+            if (ring) {
+                ring_ = *ring;
+            }
+        }
+
+        ~ThreadBuffer() {
+            Chunk* chunk = head_;
+            while (chunk) {
+                Chunk* next = chunk->next.load(std::memory_order_relaxed);
+                delete chunk;
+                chunk = next;
+            }
+            for (auto& histogram : histograms_) {
+                delete histogram.load(std::memory_order_relaxed);
+            }
+        }
+
+        ThreadBuffer(const ThreadBuffer&) = delete;
+        ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+
+        uint32_t tid() const { return tid_; }
+
+        /**
+         * @brief 在缓冲区末尾取得一个待填充的事件槽，填充后调用 commit 发布
+         * @return 流式模式下内存达到上限时返回 nullptr，事件应被丢弃
+         */
+        Event* reserve() {
+            if (storage_ != Storage::Chunks) {
+                return storage_ == Storage::Ring ? ring_.reserve() : nullptr;
+            }
+            size_t n = tail_->count.load(std::memory_order_relaxed);
+            if (n == kChunkEvents) {
+                Chunk* chunk = Systrace::get().acquireChunk();
+                if (!chunk) {
+                    return nullptr;
+                }
+                tail_->next.store(chunk, std::memory_order_release);
+                tail_ = chunk;
+                n = 0;
+            }
+            return &tail_->events[n];
+        }
+
+        /// 发布 reserve 返回的事件，仅允许所属线程调用
+        void commit() {
+            if (storage_ == Storage::Ring) {
+                ring_.commit();
+                return;
+            }
+            tail_->count.store(tail_->count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief 按时间顺序读取已发布事件的游标，可由任意线程使用
+         */
+        class Cursor {
+        public:
+            explicit Cursor(const ThreadBuffer& buffer)
+                : tid_(buffer.tid_), chunk_(buffer.head_),
+                  count_(chunk_ ? chunk_->count.load(std::memory_order_acquire) : 0) {
+                skipExhausted();
+            }
+
+            bool valid() const { return chunk_ != nullptr; }
+            uint32_t tid() const { return tid_; }
+            const Event& event() const { return chunk_->events[index_]; }
+
+            void next() {
+                ++index_;
+                skipExhausted();
+            }
+
+        private:
+            void skipExhausted() {
+                while (chunk_ && index_ >= count_) {
+                    chunk_ = count_ == kChunkEvents ? chunk_->next.load(std::memory_order_acquire) : nullptr;
+                    index_ = 0;
+                    count_ = chunk_ ? chunk_->count.load(std::memory_order_acquire) : 0;
+                }
+            }
+
+            uint32_t tid_;
+            const Chunk* chunk_;
+            size_t count_;
+            size_t index_ = 0;
+        };
+
+        /**
+         * @brief 把已发布但尚未写出的事件交给 sink，并回收写完的整块
+         *
+         * 仅由刷新线程调用。只有写满且写入线程已切换到下一块的块才会被回收。
+         */
+        template <typename Sink, typename Recycle>
+        void drain(Sink&& sink, Recycle&& recycle) {
+            while (true) {
+                Chunk* chunk = head_;
+                size_t n = chunk->count.load(std::memory_order_acquire);
+                if (n > drained_) {
+                    sink(chunk->events + drained_, n - drained_);
+                    drained_ = n;
+                }
+                if (n < kChunkEvents) {
+                    break;
+                }
+                Chunk* next = chunk->next.load(std::memory_order_acquire);
+                if (!next) {
+                    break;
+                }
+                head_ = next;
+                drained_ = 0;
+                recycle(chunk);
+            }
+        }
+
+        /**
+         * @brief 把一次作用域时长折叠进该名称的直方图，仅所属线程调用
+         *
+         * 直方图在名称首次出现时分配，之后内存不再增长。
+         */
+        void recordDuration(uint32_t name, int64_t dur) {
+            if (name >= kMaxSummaryNames) {
+                return;
+            }
+            TraceHistogram* histogram = histograms_[name].load(std::memory_order_relaxed);
+            if (!histogram) {
+                histogram = new TraceHistogram;
+                histograms_[name].store(histogram, std::memory_order_release);
+            }
+            histogram->record(dur);
+        }
+
+        /// 遍历已分配的直方图 fn(name, histogram)，可由任意线程调用
+        template <typename Fn>
+        void forEachHistogram(Fn&& fn) const {
+            for (uint32_t name = 0; name < kMaxSummaryNames; ++name) {
+                const TraceHistogram* histogram = histograms_[name].load(std::memory_order_acquire);
+                if (histogram) {
+                    fn(name, *histogram);
+                }
+            }
+        }
+
+    private:
+        enum class Storage { Chunks, Ring, Discard };
+
+        const uint32_t tid_;
+        Chunk* head_;           ///< 内存模式下不变；流式模式下由刷新线程推进
+        Chunk* tail_;           ///< 仅所属线程访问
+        Storage storage_ = Storage::Chunks;
+        TraceFlightRing ring_;  ///< 飞行记录模式下的环形缓冲区
+        size_t drained_ = 0;    ///< head_ 块中已写出的事件数，仅刷新线程访问
+        std::atomic<TraceHistogram*> histograms_[kMaxSummaryNames]{}; ///< 名称ID -> 直方图
     };
 
     /**
@@ -42,39 +243,272 @@ public:
         return instance;
     }
 
+    /**
+     * @brief 类别是否启用
+     *
+     * 热路径上只有一次 relaxed 原子读和一次分支，宏在未启用时不会求值名称和参数。
+     */
+    static bool isEnabled(uint16_t category) {
+        return (enabled_categories_.load(std::memory_order_relaxed) & category) != 0;
+    }
+
+    /// 是否有任何类别启用
+    static bool anyEnabled() {
+        return enabled_categories_.load(std::memory_order_relaxed) != 0;
+    }
+
+    /// 设置启用的类别掩码
+    static void setEnabledCategories(uint32_t mask) {
+        enabled_categories_.store(mask & kTraceCatAll, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 按逗号分隔的类别名启用记录，例如 "io,queue"、"all" 或 "none"
+     * @return 包含未知类别名时返回 false，且不修改当前设置
+     */
+    static bool enableCategories(const std::string& list) {
+        bool ok = true;
+        uint32_t mask = parseCategories(list, &ok);
+        if (ok) {
+            setEnabledCategories(mask);
+        }
+        return ok;
+    }
+
+    static uint32_t parseCategories(const std::string& list, bool* ok = nullptr) {
+        uint32_t mask = 0;
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            std::string item = list.substr(start, end - start);
+            if (item == "all") {
+                mask = kTraceCatAll;
+            } else if (!item.empty() && item != "none") {
+                size_t i = 0;
+                while (i < kTraceCategoryCount && item != kTraceCategoryNames[i]) {
+                    ++i;
+                }
+                if (i < kTraceCategoryCount) {
+                    mask |= 1u << i;
+                } else if (ok) {
+                    *ok = false;
+                }
+            }
+            start = end + 1;
+        }
+        return mask;
+    }
+
+    /// 设置记录模式 (Mode 的组合)
+    static void setMode(uint32_t mode) {
+        mode_.store(mode, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 按名称设置记录模式："record"、"summary" 或 "both"
+     * @return 未知名称时返回 false，且不修改当前设置
+     */
+    static bool setMode(const std::string& name) {
+        uint32_t mode = parseMode(name);
+        if (mode == 0) {
+            return false;
+        }
+        setMode(mode);
+        return true;
+    }
+
+    static uint32_t mode() {
+        return mode_.load(std::memory_order_relaxed);
+    }
+
+    /// 是否记录完整事件流
+    static bool recording() {
+        return (mode() & kModeRecord) != 0;
+    }
+
+    /// 是否输出作用域时长统计
+    static bool summarizing() {
+        return (mode() & kModeSummary) != 0;
+    }
+
+    static uint32_t parseMode(const std::string& name) {
+        if (name == "record") return kModeRecord;
+        if (name == "summary") return kModeSummary;
+        if (name == "both") return kModeRecord | kModeSummary;
+        return 0;
+    }
+
+    /**
+     * @brief 开关作用域性能计数器
+     *
+     * 开启后每个 AutoTrace 作用域在开始和结束时读取本线程的 perf_event_open 计数器，
+     * 增量作为该作用域 X 事件的参数导出。硬件计数器不可用时只记录软件计数器。
+     * 也可以通过环境变量 SYSTRACE_PERF=1 开启。
+     */
+    static void setPerfCounters(bool enabled) {
+        perf_counters_.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool perfCounters() {
+        return perf_counters_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 驻留事件名称或参数键，返回稳定的名称ID
+     *
+     * 相同字符串总是得到相同ID。宏会把结果缓存在调用点的静态变量中，
+     * 因此每个调用点只在首次执行时加锁查表。
+     */
+    uint32_t intern(const std::string& name) {
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        auto it = name_ids_.find(name);
+        if (it != name_ids_.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names_.size());
+        names_.push_back(name);
+        name_ids_.emplace(name, id);
+        if (flight_active_.load(std::memory_order_relaxed)) {
+            flight_.appendString(TraceRecordKind::Name, id, name);
+        }
+        return id;
+    }
+
+    /**
+     * @brief 获取名称ID对应的字符串
+     */
+    std::string nameOf(uint32_t id) const {
+        std::lock_guard<std::mutex> lock(names_mutex_);
+        return id < names_.size() ? names_[id] : std::string();
+    }
+
     /**
      * @brief 开始一个跟踪事件
-     * @param name 事件名称
-     * @param args 额外参数 (JSON 格式字符串)
+     * @param category 事件类别
+     * @param name 事件名称ID
+     * @param args 额外参数 (最多 kMaxArgs 个)
      */
-    void beginEvent(const std::string& name, const std::string& args = "") {
-        addEvent(name, 'B', args);
+    template <typename... Args>
+    void beginEvent(uint16_t category, uint32_t name, const Args&... args) {
+        addEvent(category, name, 'B', args...);
     }
 
     /**
      * @brief 结束一个跟踪事件
-     * @param name 事件名称
+     * @param category 事件类别
+     * @param name 事件名称ID
      */
-    void endEvent(const std::string& name) {
-        addEvent(name, 'E');
+    void endEvent(uint16_t category, uint32_t name) {
+        addEvent(category, name, 'E');
     }
 
     /**
      * @brief 添加即时事件
-     * @param name 事件名称
-     * @param args 额外参数 (JSON 格式字符串)
+     * @param category 事件类别
+     * @param name 事件名称ID
+     * @param args 额外参数 (最多 kMaxArgs 个)
      */
-    void instantEvent(const std::string& name, const std::string& args = "") {
-        addEvent(name, 'I', args);
+    template <typename... Args>
+    void instantEvent(uint16_t category, uint32_t name, const Args&... args) {
+        addEvent(category, name, 'I', args...);
+    }
+
+    /**
+     * @brief 添加完整事件 (X)，一条记录同时包含开始时间和时长
+     * @param category 事件类别
+     * @param name 事件名称ID
+     * @param start 开始时间 (纳秒，见 now())
+     * @param dur 时长 (纳秒)
+     * @param args 额外参数
+     * @param argc 参数个数 (最多 kMaxArgs 个)
+     * @param perf 作用域内的性能计数器增量，紧跟 X 事件写入一条 P 事件
+     */
+    void completeEvent(uint16_t category, uint32_t name, int64_t start, int64_t dur,
+                       const Arg* args, size_t argc, const TracePerfDeltas* perf = nullptr) {
+        uint32_t mode = mode_.load(std::memory_order_relaxed);
+        ThreadBuffer& buffer = currentBuffer();
+        if (mode & kModeSummary) {
+            buffer.recordDuration(name, dur);
+        }
+        if (!(mode & kModeRecord)) {
+            return;
+        }
+        Event* event = prepareEvent(buffer, category, name, 'X', start);
+        if (!event) {
+            return;
+        }
+        event->dur = dur;
+        event->argc = static_cast<uint8_t>(std::min(argc, kMaxArgs));
+        std::copy(args, args + event->argc, event->args);
+        if (perf) {
+            event->flags = kTraceEventHasPerf;
+        }
+        buffer.commit();
+
+        if (perf && (event = prepareEvent(buffer, category, name, 'P', start)) != nullptr) {
+            traceStorePerf(*event, *perf);
+            buffer.commit();
+        }
+    }
+
+    /**
+     * @brief 添加带关联ID的事件：流事件 (s/t/f) 或异步区间 (b/e)
+     * @param category 事件类别
+     * @param name 事件名称ID，同一条流或异步区间的各事件须使用相同名称和类别
+     * @param type 事件类型
+     * @param id 关联ID
+     *
+     * 流事件绑定到当前线程上包含它的切片，用于画出跨线程的箭头；
+     * 异步区间可以在一个线程开始、在另一个线程结束。
+     */
+    void idEvent(uint16_t category, uint32_t name, char type, uint64_t id) {
+        if (!recording()) {
+            return;
+        }
+        ThreadBuffer& buffer = currentBuffer();
+        Event* event = prepareEvent(buffer, category, name, type, clock_.now());
+        if (!event) {
+            return;
+        }
+        event->id = id;
+        buffer.commit();
+    }
+
+    /// 当前跟踪时间 (纳秒)
+    int64_t now() const {
+        return clock_.now();
     }
 
     /**
      * @brief 添加计数器事件
-     * @param name 计数器名称
+     * @param category 事件类别
+     * @param name 计数器名称ID
      * @param value 计数器值
      */
-    void counterEvent(const std::string& name, int value) {
-        addEvent(name, 'C', "{\"value\":" + std::to_string(value) + "}");
+    void counterEvent(uint16_t category, uint32_t name, int64_t value) {
+        static const uint32_t value_key = intern("value");
+        addEvent(category, name, 'C', Arg(value_key, value));
+    }
+
+    /**
+     * @brief 把一个作用域内的堆分配写到该作用域名称的计数器轨道 "Alloc: <名称>"
+     * @param name 作用域名称ID
+     * @param stats 作用域内（不含子作用域）的分配统计
+     */
+    void allocEvent(uint32_t name, const TraceAlloc::Stats& stats) {
+        static const uint32_t bytes_key = intern("bytes");
+        static const uint32_t count_key = intern("allocs");
+        static thread_local std::vector<uint32_t> tracks;   // 作用域名称ID -> 轨道名称ID + 1
+        if (name >= tracks.size()) {
+            tracks.resize(name + 1, 0);
+        }
+        if (tracks[name] == 0) {
+            tracks[name] = intern("Alloc: " + nameOf(name)) + 1;
+        }
+        addEvent(Category::mem, tracks[name] - 1, 'C', Arg(bytes_key, stats.bytes), Arg(count_key, stats.count));
     }
 
     /**
@@ -82,7 +516,8 @@ public:
      * @param usage 内存使用量(KB)
      */
     void memoryEvent(size_t usage) {
-        counterEvent("MemoryUsage", static_cast<int>(usage));
+        static const uint32_t name = intern("MemoryUsage");
+        counterEvent(Category::mem, name, static_cast<int64_t>(usage));
     }
 
     /**
@@ -92,6 +527,10 @@ public:
     void setThreadName(const std::string& name) {
         std::lock_guard<std::mutex> lock(thread_name_mutex_);
         thread_names_[getCurrentThreadId()] = name;
+        ++thread_names_version_;
+        if (flight_active_.load(std::memory_order_relaxed)) {
+            flight_.appendString(TraceRecordKind::ThreadName, getCurrentThreadId(), name);
+        }
     }
 
     /**
@@ -103,199 +542,784 @@ public:
         if (it != thread_names_.end()) {
             return it->second;
         }
-        
+
         // 如果未设置名称，返回默认名称
         return "Thread-" + std::to_string(tid);
     }
 
+    /**
+     * @brief 启用流式模式：后台线程周期性地把事件以二进制格式写入文件
+     * @param filepath 二进制跟踪文件路径，可用 systrace2json 转换为 JSON
+     * @param max_memory 事件缓冲区内存上限（字节），超出时新事件被丢弃并计数
+     * @return 文件无法打开时返回 false，继续使用内存模式
+     *
+     * 应在记录任何事件之前调用。
+     */
+    bool startStreaming(const fs::path& filepath, size_t max_memory = kDefaultStreamMemory) {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (stream_file_) {
+            return true;
+        }
+        if (flight_active_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        stream_file_ = std::fopen(filepath.string().c_str(), "wb");
+        if (!stream_file_) {
+            std::cerr << "Systrace: Failed to open trace file: " << filepath << std::endl;
+            return false;
+        }
+        std::setvbuf(stream_file_, nullptr, _IOFBF, 1 << 20);
+
+        TraceFileHeader header;
+        std::memcpy(header.magic, kTraceFileMagic, sizeof(header.magic));
+        header.version = kTraceFileVersion;
+        header.event_size = sizeof(Event);
+        std::fwrite(&header, sizeof(header), 1, stream_file_);
+
+        stream_path_ = filepath;
+        {
+            std::lock_guard<std::mutex> pool_lock(pool_mutex_);
+            max_chunks_ = std::max<size_t>(1, max_memory / sizeof(Chunk));
+        }
+        stop_flusher_ = false;
+        streaming_.store(true, std::memory_order_release);
+        flusher_ = std::thread([this]() { flusherLoop(); });
+        return true;
+    }
+
+    /**
+     * @brief 启用飞行记录模式：各线程事件写入 mmap 文件中的环形缓冲区，只保留最近的事件
+     * @param filepath 飞行记录文件路径
+     * @param size 文件大小（字节），平分给 max_threads 个线程
+     * @param max_threads 最多记录的线程数，之后注册的线程事件被丢弃并计数
+     * @return 文件无法创建或已在流式模式时返回 false，继续使用内存模式
+     *
+     * 应在记录任何事件之前调用。进程崩溃或被杀死后，文件仍可用 systrace2json 转换为 JSON；
+     * 正常退出时 saveToFile 直接从映射中导出。
+     */
+    bool startFlightRecorder(const fs::path& filepath, size_t size,
+                             uint32_t max_threads = TraceFlightRecorder::kDefaultThreads) {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (flight_active_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (stream_file_) {
+            return false;
+        }
+        if (!flight_.open(filepath.string(), size, max_threads)) {
+            std::cerr << "Systrace: Failed to create flight recorder file: " << filepath << std::endl;
+            return false;
+        }
+        flight_path_ = filepath;
+
+        // 写出已有的名称，之后新驻留的名称由 intern / setThreadName 追加
+        std::lock_guard<std::mutex> name_lock(names_mutex_);
+        std::lock_guard<std::mutex> thread_name_lock(thread_name_mutex_);
+        for (uint32_t id = 0; id < names_.size(); ++id) {
+            flight_.appendString(TraceRecordKind::Name, id, names_[id]);
+        }
+        for (const auto& [tid, name] : thread_names_) {
+            flight_.appendString(TraceRecordKind::ThreadName, tid, name);
+        }
+        flight_active_.store(true, std::memory_order_release);
+        std::cout << "Systrace: Flight recorder keeps the last " << flight_.slotEvents()
+                  << " events per thread in " << filepath << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief 停止流式模式，写出所有剩余事件并关闭文件
+     */
+    void stopStreaming() {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (!stream_file_) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+            stop_flusher_ = true;
+        }
+        flush_cv_.notify_one();
+        flusher_.join();
+
+        std::fclose(stream_file_);
+        stream_file_ = nullptr;
+
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        std::cout << "Systrace: Streamed " << streamed_events_ << " events to " << stream_path_;
+        if (dropped > 0) {
+            std::cout << " (" << dropped << " dropped at the memory cap)";
+        }
+        std::cout << std::endl;
+        std::cout << "Convert with: systrace2json " << stream_path_ << " <output.json>" << std::endl;
+    }
+
     /**
      * @brief 保存跟踪数据到文件
      * @param filepath 输出文件路径
+     *
+     * 各线程的事件已按时间排序，导出时直接 k 路归并写出，不复制也不整体排序。
+     * 流式模式下只结束二进制文件，JSON 由 systrace2json 离线生成。
+     * 统计模式下同时打印统计表，并在同目录写出 <文件名>.summary.json。
      */
     void saveToFile(const fs::path& filepath) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::ofstream file(filepath);
-        if (!file.is_open()) {
+        if (summarizing()) {
+            fs::path summary_path = filepath.parent_path() / (filepath.stem().string() + ".summary.json");
+            printSummary(std::cout);
+            saveSummary(summary_path);
+        }
+        if (!recording()) {
+            return;
+        }
+        if (streaming_.load(std::memory_order_acquire)) {
+            stopStreaming();
+            return;
+        }
+        if (flight_active_.load(std::memory_order_acquire)) {
+            saveFlightRecord(filepath);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        std::FILE* file = std::fopen(filepath.string().c_str(), "wb");
+        if (!file) {
             std::cerr << "Systrace: Failed to open trace file: " << filepath << std::endl;
             return;
         }
 
-        // 添加元数据事件：线程名称
-        std::vector<Event> metadata_events;
+        std::vector<std::string> names;
         {
-            std::lock_guard<std::mutex> name_lock(thread_name_mutex_);
-            auto start_time = std::chrono::high_resolution_clock::now();
-            
-            for (const auto& [tid, name] : thread_names_) {
-                Event md_event;
-                md_event.name = "thread_name";
-                md_event.type = 'M';
-                md_event.tid = tid;
-                md_event.ts = start_time;
-                md_event.args = "{\"name\":\"" + escapeJson(name) + "\"}";
-                metadata_events.push_back(md_event);
+            std::lock_guard<std::mutex> name_lock(names_mutex_);
+            names = names_;
+        }
+
+        std::vector<ThreadBuffer::Cursor> cursors;
+        cursors.reserve(buffers_.size());
+        for (const auto& buffer : buffers_) {
+            cursors.emplace_back(*buffer);
+        }
+
+        size_t count = 0;
+        {
+            // 元数据事件（线程名称）在前
+            TraceJsonWriter writer(file, names);
+            {
+                std::lock_guard<std::mutex> name_lock(thread_name_mutex_);
+                for (const auto& [tid, name] : thread_names_) {
+                    writer.writeThreadName(tid, name);
+                }
             }
+            mergeTraceStreams(cursors, [&](uint32_t tid, const Event& event) {
+                writer.writeEvent(tid, event);
+            });
+            writer.finish();
+            count = writer.count();
         }
+        std::fclose(file);
 
-        // 合并元数据事件和普通事件
-        std::vector<Event> all_events;
-        all_events.reserve(metadata_events.size() + events_.size());
-        all_events.insert(all_events.end(), metadata_events.begin(), metadata_events.end());
-        all_events.insert(all_events.end(), events_.begin(), events_.end());
+        std::cout << "Systrace: Saved " << count
+                  << " events to " << filepath << std::endl;
+        std::cout << "Open chrome://tracing in Chrome browser and load this file for visualization." << std::endl;
+    }
 
-        // 按时间戳排序
-        std::sort(all_events.begin(), all_events.end(), [](const Event& a, const Event& b) {
-            return a.ts < b.ts;
+    /**
+     * @brief 把飞行记录文件中当前保留的事件导出为 JSON
+     */
+    void saveFlightRecord(const fs::path& filepath) {
+        TraceContents contents;
+        std::string error;
+        if (!readTraceFlight(flight_.data(), flight_.size(), contents, error)) {
+            std::cerr << "Systrace: " << error << std::endl;
+            return;
+        }
+        std::FILE* file = std::fopen(filepath.string().c_str(), "wb");
+        if (!file) {
+            std::cerr << "Systrace: Failed to open trace file: " << filepath << std::endl;
+            return;
+        }
+        size_t count = writeTraceJson(file, contents);
+        std::fclose(file);
+        std::cout << "Systrace: Saved the last " << count << " events from " << flight_path_
+                  << " to " << filepath << std::endl;
+        if (contents.dropped > 0) {
+            std::cout << "Note: " << contents.dropped << " events were dropped from threads without a ring" << std::endl;
+        }
+    }
+
+    /// 统计表中的一行：某名称在某线程（tid 为 0 表示所有线程合计）上的时长分布
+    struct SummaryRow {
+        std::string name;
+        std::string thread;
+        uint32_t tid;
+        uint64_t count;
+        double min_us, p50_us, p90_us, p99_us, max_us, mean_us;
+    };
+
+    /**
+     * @brief 汇总各线程直方图，按名称排序；名称在多个线程出现时额外给出合计行
+     */
+    std::vector<SummaryRow> summaryRows() const {
+        std::map<uint32_t, std::vector<std::pair<uint32_t, const TraceHistogram*>>> by_name;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex_);
+            for (const auto& buffer : buffers_) {
+                uint32_t tid = buffer->tid();
+                buffer->forEachHistogram([&](uint32_t name, const TraceHistogram& histogram) {
+                    by_name[name].emplace_back(tid, &histogram);
+                });
+            }
+        }
+
+        auto makeRow = [](std::string name, std::string thread, uint32_t tid, const TraceHistogram& h) {
+            return SummaryRow{std::move(name), std::move(thread), tid, h.count(),
+                              h.min() / 1e3, h.percentile(0.50) / 1e3, h.percentile(0.90) / 1e3,
+                              h.percentile(0.99) / 1e3, h.max() / 1e3, h.mean() / 1e3};
+        };
+
+        std::vector<SummaryRow> rows;
+        for (const auto& [name_id, histograms] : by_name) {
+            std::string name = nameOf(name_id);
+            if (histograms.size() > 1) {
+                auto total = std::make_unique<TraceHistogram>();
+                for (const auto& entry : histograms) {
+                    total->merge(*entry.second);
+                }
+                rows.push_back(makeRow(name, "(all)", 0, *total));
+            }
+            for (const auto& [tid, histogram] : histograms) {
+                rows.push_back(makeRow(name, getThreadName(tid), tid, *histogram));
+            }
+        }
+        std::stable_sort(rows.begin(), rows.end(), [](const SummaryRow& a, const SummaryRow& b) {
+            return a.name < b.name;
         });
+        return rows;
+    }
 
-        // 写入文件
+    /**
+     * @brief 打印作用域时长统计表 (微秒)
+     */
+    void printSummary(std::ostream& out) const {
+        std::vector<SummaryRow> rows = summaryRows();
+        out << "\nSystrace summary (us)\n";
+        out << std::left << std::setw(24) << "Scope" << std::setw(18) << "Thread" << std::right
+            << std::setw(10) << "Count" << std::setw(11) << "p50" << std::setw(11) << "p90"
+            << std::setw(11) << "p99" << std::setw(11) << "max" << std::setw(11) << "mean" << "\n";
+        out << std::fixed << std::setprecision(1);
+        for (const auto& row : rows) {
+            out << std::left << std::setw(24) << row.name << std::setw(18) << row.thread << std::right
+                << std::setw(10) << row.count << std::setw(11) << row.p50_us << std::setw(11) << row.p90_us
+                << std::setw(11) << row.p99_us << std::setw(11) << row.max_us << std::setw(11) << row.mean_us
+                << "\n";
+        }
+        out << std::defaultfloat << std::flush;
+    }
+
+    /**
+     * @brief 把作用域时长统计写成 JSON 数组
+     * @param filepath 输出文件路径
+     */
+    bool saveSummary(const fs::path& filepath) const {
+        std::ofstream file(filepath);
+        if (!file.is_open()) {
+            std::cerr << "Systrace: Failed to open summary file: " << filepath << std::endl;
+            return false;
+        }
+        std::vector<SummaryRow> rows = summaryRows();
         file << "[\n";
-        bool first = true;
-        for (const auto& event : all_events) {
-            auto us = std::chrono::time_point_cast<std::chrono::microseconds>(event.ts);
-            auto epoch = us.time_since_epoch();
-            auto value = std::chrono::duration_cast<std::chrono::microseconds>(epoch).count();
-
-            if (!first) file << ",\n";
-            first = false;
-
-            file << "{";
-            file << "\"name\":\"" << escapeJson(event.name) << "\",";
-            file << "\"ph\":\"" << event.type << "\",";
-            file << "\"ts\":" << value << ",";
-            file << "\"pid\":0,";
-            file << "\"tid\":" << event.tid;
-            
-            if (!event.args.empty()) {
-                file << ",\"args\":" << event.args;
-            }
-            
-            file << "}";
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const SummaryRow& row = rows[i];
+            file << "{\"name\":\"" << escapeJson(row.name) << "\",\"thread\":\"" << escapeJson(row.thread)
+                 << "\",\"tid\":" << row.tid << ",\"count\":" << row.count
+                 << ",\"min_us\":" << row.min_us << ",\"p50_us\":" << row.p50_us
+                 << ",\"p90_us\":" << row.p90_us << ",\"p99_us\":" << row.p99_us
+                 << ",\"max_us\":" << row.max_us << ",\"mean_us\":" << row.mean_us << "}"
+                 << (i + 1 < rows.size() ? ",\n" : "\n");
+        }
+        file << "]\n";
+        std::cout << "Systrace: Saved summary of " << rows.size() << " scopes to " << filepath << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief 在后台线程中保存跟踪数据，调用方无需等待导出完成
+     * @param filepath 输出文件路径
+     *
+     * 进程正常退出时（单例析构）会等待导出完成。
+     */
+    void saveToFileAsync(const fs::path& filepath) {
+        std::lock_guard<std::mutex> lock(export_mutex_);
+        if (export_thread_.joinable()) {
+            export_thread_.join();
+        }
+        export_thread_ = std::thread([this, filepath]() { saveToFile(filepath); });
+    }
+
+    /**
+     * @brief 等待 saveToFileAsync 启动的导出完成
+     */
+    void waitForSave() {
+        std::lock_guard<std::mutex> lock(export_mutex_);
+        if (export_thread_.joinable()) {
+            export_thread_.join();
         }
-        file << "\n]";
-        
-        std::cout << "Systrace: Saved " << all_events.size() 
-                  << " events to " << filepath << std::endl;
-        std::cout << "Open chrome://tracing in Chrome browser and load this file for visualization." << std::endl;
     }
 
     /**
      * @brief 自动跟踪作用域的 RAII 包装器
+     *
+     * 构造时只检查类别是否启用；启用时由宏调用 begin 记下开始时间和参数，
+     * 作用域结束时写入一条完整事件 (X)。未启用的类别不会求值名称和参数。
+     * 开启性能计数器时，begin 和析构各读取一次计数器快照。
+     * 链接了分配钩子 (systrace_alloc.cpp) 时，作用域内的分配记到本作用域，
+     * mem 类别启用时在结束时写出分配计数器。
      */
     class AutoTrace {
     public:
-        AutoTrace(const std::string& name, const std::string& args = "") 
-            : name_(name) {
-            Systrace::get().beginEvent(name, args);
-        }
-        
+        explicit AutoTrace(uint16_t category)
+            : category_(category), active_(Systrace::isEnabled(category)) {}
+
         ~AutoTrace() {
-            Systrace::get().endEvent(name_);
+            if (!active_) {
+                return;
+            }
+            Systrace& trace = Systrace::get();
+            if (alloc_tracked_) {
+                TraceAlloc::leaveScope(alloc_parent_);
+                if (alloc_.count > 0 && Systrace::isEnabled(Category::mem)) {
+                    trace.allocEvent(name_, alloc_);
+                }
+            }
+            int64_t dur = trace.now() - start_;
+            if (!perf_) {
+                trace.completeEvent(category_, name_, start_, dur, args_, argc_);
+                return;
+            }
+            TracePerfCounters& counters = TracePerfCounters::forThread();
+            TracePerfSample end;
+            counters.read(end);
+            TracePerfDeltas deltas;
+            deltas.mask = counters.mask();
+            for (size_t i = 0; i < kTracePerfCounterCount; ++i) {
+                deltas.values[i] = end.values[i] - perf_start_.values[i];
+            }
+            trace.completeEvent(category_, name_, start_, dur, args_, argc_, &deltas);
+        }
+
+        bool active() const { return active_; }
+
+        template <typename... Args>
+        void begin(uint32_t name, const Args&... args) {
+            static_assert(sizeof...(Args) <= kMaxArgs, "Systrace: too many event args");
+            name_ = name;
+            argc_ = sizeof...(Args);
+            size_t i = 0;
+            ((args_[i++] = args), ...);
+            (void)i;
+            if (TraceAlloc::hooked()) {
+                alloc_tracked_ = true;
+                alloc_parent_ = TraceAlloc::enterScope(&alloc_);
+            }
+            if (Systrace::perfCounters()) {
+                TracePerfCounters& counters = TracePerfCounters::forThread();
+                perf_ = counters.available();
+                if (perf_) {
+                    counters.read(perf_start_);
+                }
+            }
+            start_ = Systrace::get().now();
         }
-        
+
         // 禁止拷贝和移动
         AutoTrace(const AutoTrace&) = delete;
         AutoTrace& operator=(const AutoTrace&) = delete;
-        
+
     private:
-        std::string name_;
+        uint16_t category_;
+        bool active_;
+        uint32_t name_ = 0;
+        size_t argc_ = 0;
+        int64_t start_ = 0;
+        bool perf_ = false;
+        bool alloc_tracked_ = false;
+        TraceAlloc::Stats alloc_;
+        TraceAlloc::Stats* alloc_parent_ = nullptr;
+        TracePerfSample perf_start_;
+        Arg args_[kMaxArgs];
     };
 
     /**
      * @brief 获取当前线程的跟踪ID（兼容Cygwin）
+     *
+     * ID 在线程首次调用时分配并缓存在 thread_local 中，之后的调用无锁。
      */
     uint32_t getCurrentThreadId() const {
-        static std::mutex id_mutex;
-        static std::unordered_map<std::thread::id, uint32_t> thread_id_map;
-        static uint32_t next_id = 1;
-        
-        auto this_id = std::this_thread::get_id();
-        std::lock_guard<std::mutex> lock(id_mutex);
-        
-        auto it = thread_id_map.find(this_id);
-        if (it != thread_id_map.end()) {
-            return it->second;
-        }
-        
-        uint32_t id = next_id++;
-        thread_id_map[this_id] = id;
+        static std::atomic<uint32_t> next_id{1};
+        static thread_local const uint32_t id = next_id.fetch_add(1, std::memory_order_relaxed);
         return id;
     }
 
 private:
+    /// 预分配的定长事件块
+    struct Chunk {
+        Event events[kChunkEvents];
+        std::atomic<size_t> count{0};
+        std::atomic<Chunk*> next{nullptr};
+    };
+
     Systrace() = default;
-    ~Systrace() = default;
-    
+
+    ~Systrace() {
+        waitForSave();
+        stopStreaming();
+        for (Chunk* chunk : free_chunks_) {
+            delete chunk;
+        }
+    }
+
     // 禁止拷贝和移动
     Systrace(const Systrace&) = delete;
     Systrace& operator=(const Systrace&) = delete;
 
-    void addEvent(const std::string& name, char type, const std::string& args = "") {
-        std::lock_guard<std::mutex> lock(mutex_);
-        uint32_t tid = getCurrentThreadId();
-        events_.push_back({
-            name, 
-            type,
-            tid,
-            std::chrono::high_resolution_clock::now(),
-            args
-        });
+    template <typename... Args>
+    void addEvent(uint16_t category, uint32_t name, char type, const Args&... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "Systrace: too many event args");
+        if (!recording()) {
+            return;
+        }
+        ThreadBuffer& buffer = currentBuffer();
+        Event* event = prepareEvent(buffer, category, name, type, clock_.now());
+        if (!event) {
+            return;
+        }
+        event->argc = static_cast<uint8_t>(sizeof...(Args));
+        size_t i = 0;
+        ((event->args[i++] = args), ...);
+        (void)i;
+        buffer.commit();
+    }
+
+    /// 取得下一个事件槽并填好公共字段，内存达到上限时计数并返回 nullptr
+    Event* prepareEvent(ThreadBuffer& buffer, uint16_t category, uint32_t name, char type, int64_t ts) {
+        Event* event = buffer.reserve();
+        if (!event) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            if (flight_active_.load(std::memory_order_acquire)) {
+                flight_.addDropped(1);
+            }
+            return nullptr;
+        }
+        event->ts = ts;
+        event->name = name;
+        event->type = type;
+        event->category = category;
+        event->argc = 0;
+        event->flags = 0;
+        event->id = 0;
+        return event;
+    }
+
+    /// 当前线程的事件缓冲区，首次调用时注册到全局列表
+    ThreadBuffer& currentBuffer() {
+        static thread_local ThreadBuffer* buffer = registerThread();
+        return *buffer;
+    }
+
+    ThreadBuffer* registerThread() {
+        std::unique_ptr<ThreadBuffer> buffer;
+        if (flight_active_.load(std::memory_order_acquire)) {
+            TraceFlightRing ring;
+            bool claimed = flight_.claimSlot(getCurrentThreadId(), ring);
+            buffer = std::make_unique<ThreadBuffer>(getCurrentThreadId(), claimed ? &ring : nullptr);
+        } else {
+            // 每个线程至少持有一块，即使流式模式已达到内存上限
+            Chunk* first = acquireChunk();
+            if (!first) {
+                first = new Chunk;
+            }
+            buffer = std::make_unique<ThreadBuffer>(getCurrentThreadId(), first);
+        }
+        ThreadBuffer* raw = buffer.get();
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        buffers_.push_back(std::move(buffer));
+        return raw;
+    }
+
+    /**
+     * @brief 为写满的线程缓冲区分配新块
+     *
+     * 内存模式下直接分配；流式模式下从空闲池取块，池空且已达上限时返回 nullptr。
+     */
+    Chunk* acquireChunk() {
+        if (!streaming_.load(std::memory_order_acquire)) {
+            return new Chunk;
+        }
+        if (pool_exhausted_.load(std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        if (!free_chunks_.empty()) {
+            Chunk* chunk = free_chunks_.back();
+            free_chunks_.pop_back();
+            return chunk;
+        }
+        if (allocated_chunks_ < max_chunks_) {
+            ++allocated_chunks_;
+            return new Chunk;
+        }
+        pool_exhausted_.store(true, std::memory_order_relaxed);
+        flush_cv_.notify_one();
+        return nullptr;
+    }
+
+    /// 刷新线程写完一块后放回空闲池
+    void recycleChunk(Chunk* chunk) {
+        chunk->count.store(0, std::memory_order_relaxed);
+        chunk->next.store(nullptr, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        free_chunks_.push_back(chunk);
+        pool_exhausted_.store(false, std::memory_order_relaxed);
     }
-    
-    std::string escapeJson(const std::string& input) {
-        std::ostringstream ss;
-        for (char c : input) {
-            switch (c) {
-                case '"': ss << "\\\""; break;
-                case '\\': ss << "\\\\"; break;
-                case '\b': ss << "\\b"; break;
-                case '\f': ss << "\\f"; break;
-                case '\n': ss << "\\n"; break;
-                case '\r': ss << "\\r"; break;
-                case '\t': ss << "\\t"; break;
-                default: ss << c;
+
+    void flusherLoop() {
+        std::unique_lock<std::mutex> lock(flush_mutex_);
+        while (!stop_flusher_) {
+            flush_cv_.wait_for(lock, kFlushInterval);
+            lock.unlock();
+            flushOnce();
+            lock.lock();
+        }
+        lock.unlock();
+        flushOnce();
+    }
+
+    /// 写出新驻留的名称、线程名称和各线程新发布的事件
+    void flushOnce() {
+        {
+            std::lock_guard<std::mutex> lock(names_mutex_);
+            for (; names_written_ < names_.size(); ++names_written_) {
+                writeStringRecord(TraceRecordKind::Name, names_written_, names_[names_written_]);
             }
         }
-        return ss.str();
+        {
+            std::lock_guard<std::mutex> lock(thread_name_mutex_);
+            if (thread_names_version_ != thread_names_written_) {
+                for (const auto& [tid, name] : thread_names_) {
+                    writeStringRecord(TraceRecordKind::ThreadName, tid, name);
+                }
+                thread_names_written_ = thread_names_version_;
+            }
+        }
+
+        std::vector<ThreadBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex_);
+            for (const auto& buffer : buffers_) {
+                buffers.push_back(buffer.get());
+            }
+        }
+        for (ThreadBuffer* buffer : buffers) {
+            uint32_t tid = buffer->tid();
+            buffer->drain(
+                [&](const Event* events, size_t count) { writeEventsRecord(tid, events, count); },
+                [&](Chunk* chunk) { recycleChunk(chunk); });
+        }
+
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != dropped_written_) {
+            TraceRecordHeader header{TraceRecordKind::Dropped, sizeof(dropped)};
+            std::fwrite(&header, sizeof(header), 1, stream_file_);
+            std::fwrite(&dropped, sizeof(dropped), 1, stream_file_);
+            dropped_written_ = dropped;
+        }
+        std::fflush(stream_file_);
+    }
+
+    void writeStringRecord(TraceRecordKind kind, uint32_t id, const std::string& value) {
+        TraceRecordHeader header{kind, static_cast<uint32_t>(sizeof(id) + value.size())};
+        std::fwrite(&header, sizeof(header), 1, stream_file_);
+        std::fwrite(&id, sizeof(id), 1, stream_file_);
+        std::fwrite(value.data(), 1, value.size(), stream_file_);
+    }
+
+    void writeEventsRecord(uint32_t tid, const Event* events, size_t count) {
+        uint32_t n = static_cast<uint32_t>(count);
+        TraceRecordHeader header{TraceRecordKind::Events,
+                                 static_cast<uint32_t>(sizeof(tid) + sizeof(n) + count * sizeof(Event))};
+        std::fwrite(&header, sizeof(header), 1, stream_file_);
+        std::fwrite(&tid, sizeof(tid), 1, stream_file_);
+        std::fwrite(&n, sizeof(n), 1, stream_file_);
+        std::fwrite(events, sizeof(Event), count, stream_file_);
+        streamed_events_ += count;
+    }
+
+    /// 从环境变量 SYSTRACE_CATEGORIES 读取初始类别，未设置时全部关闭
+    static uint32_t categoriesFromEnv() {
+        const char* env = std::getenv("SYSTRACE_CATEGORIES");
+        return env ? parseCategories(env) : 0;
+    }
+
+    static inline std::atomic<uint32_t> enabled_categories_{categoriesFromEnv()};
+
+    /// 从环境变量 SYSTRACE_MODE 读取记录模式，未设置时只记录事件流
+    static uint32_t modeFromEnv() {
+        const char* env = std::getenv("SYSTRACE_MODE");
+        uint32_t mode = env ? parseMode(env) : 0;
+        return mode ? mode : kModeRecord;
     }
 
-    mutable std::mutex mutex_;
+    static inline std::atomic<uint32_t> mode_{modeFromEnv()};
+
+    /// 环境变量 SYSTRACE_PERF 为 1 时开启性能计数器
+    static bool perfFromEnv() {
+        const char* env = std::getenv("SYSTRACE_PERF");
+        return env && std::strcmp(env, "1") == 0;
+    }
+
+    static inline std::atomic<bool> perf_counters_{perfFromEnv()};
+
+    static std::string escapeJson(const std::string& input) {
+        std::string out;
+        out.reserve(input.size());
+        traceAppendJsonEscaped(out, input.data(), input.size());
+        return out;
+    }
+
+    const TraceClock& clock_ = TraceClock::get();
+    mutable std::mutex registry_mutex_;     ///< 保护 buffers_，仅在线程注册和导出时加锁
     mutable std::mutex thread_name_mutex_;
-    std::vector<Event> events_;
+    mutable std::mutex names_mutex_;        ///< 保护名称驻留表
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_; ///< 线程退出后缓冲区仍保留到导出
     std::map<uint32_t, std::string> thread_names_;
+    uint64_t thread_names_version_ = 0;                  ///< 每次设置线程名称时递增
+    std::vector<std::string> names_;                     ///< 名称ID -> 字符串
+    std::unordered_map<std::string, uint32_t> name_ids_; ///< 字符串 -> 名称ID
+
+    // 后台导出
+    std::mutex export_mutex_;
+    std::thread export_thread_;
+
+    // 流式模式
+    std::mutex stream_mutex_;               ///< 串行化 start/stopStreaming
+    std::atomic<bool> streaming_{false};
+    std::FILE* stream_file_ = nullptr;
+    fs::path stream_path_;
+    std::thread flusher_;
+    std::mutex flush_mutex_;
+    std::condition_variable flush_cv_;
+    bool stop_flusher_ = false;
+    std::mutex pool_mutex_;                 ///< 保护空闲块池
+    std::vector<Chunk*> free_chunks_;
+    size_t allocated_chunks_ = 0;
+    size_t max_chunks_ = 0;
+    std::atomic<bool> pool_exhausted_{false};
+    std::atomic<uint64_t> dropped_{0};
+    // 以下仅刷新线程访问
+    uint32_t names_written_ = 0;
+    uint64_t thread_names_written_ = 0;
+    uint64_t dropped_written_ = 0;
+    uint64_t streamed_events_ = 0;
+
+    // 飞行记录模式
+    TraceFlightRecorder flight_;
+    std::atomic<bool> flight_active_{false};
+    fs::path flight_path_;
 };
 
 // ===================== 简化使用的宏 =====================
+// 第一个参数是类别 (io, convert, queue, mem, pipeline)，类别未启用时宏的其余参数不会被求值。
+// 名称和参数键必须是字符串字面量（或 __FUNCTION__），每个调用点只驻留一次。
 #ifdef ENABLE_TRACING
-#define TRACE_SCOPE(name) Systrace::AutoTrace __trace_scope__(name)
-#define TRACE_SCOPE_ARGS(name, args) Systrace::AutoTrace __trace_scope__(name, args)
-#define TRACE_FUNCTION() Systrace::AutoTrace __trace_scope__(__FUNCTION__)
-#define TRACE_FUNCTION_ARGS(args) Systrace::AutoTrace __trace_scope__(__FUNCTION__, args)
-#define TRACE_COUNTER(name, value) Systrace::get().counterEvent(name, value)
-#define TRACE_MEMORY(usage) Systrace::get().memoryEvent(usage)
-#define TRACE_INSTANT(name) Systrace::get().instantEvent(name)
-#define TRACE_INSTANT_ARGS(name, args) Systrace::get().instantEvent(name, args)
-#define TRACE_BEGIN(name) Systrace::get().beginEvent(name)
-#define TRACE_BEGIN_ARGS(name, args) Systrace::get().beginEvent(name, args)
-#define TRACE_END(name) Systrace::get().endEvent(name)
+#define TRACE_CATEGORY(cat) Systrace::Category::cat
+#define TRACE_NAME_ID(name) ([](const char* n) { static const uint32_t id = Systrace::get().intern(n); return id; }(name))
+#define TRACE_ARG(key, value) Systrace::Arg(TRACE_NAME_ID(key), value)
+#define TRACE_ENABLED() Systrace::anyEnabled()
+#define TRACE_RECORDING() (Systrace::anyEnabled() && Systrace::recording())
+#define TRACE_SET_MODE(name) Systrace::setMode(std::string(name))
+#define TRACE_SET_PERF_COUNTERS(enabled) Systrace::setPerfCounters(enabled)
+#define TRACE_SCOPE(cat, name) \
+    Systrace::AutoTrace __trace_scope__(TRACE_CATEGORY(cat)); \
+    if (__trace_scope__.active()) __trace_scope__.begin(TRACE_NAME_ID(name))
+#define TRACE_SCOPE_ARGS(cat, name, ...) \
+    Systrace::AutoTrace __trace_scope__(TRACE_CATEGORY(cat)); \
+    if (__trace_scope__.active()) __trace_scope__.begin(TRACE_NAME_ID(name), __VA_ARGS__)
+#define TRACE_FUNCTION(cat) TRACE_SCOPE(cat, __FUNCTION__)
+#define TRACE_FUNCTION_ARGS(cat, ...) TRACE_SCOPE_ARGS(cat, __FUNCTION__, __VA_ARGS__)
+#define TRACE_COUNTER(cat, name, value) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().counterEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name), value); \
+    } while (0)
+#define TRACE_MEMORY(usage) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(mem))) Systrace::get().memoryEvent(usage); \
+    } while (0)
+#define TRACE_INSTANT(cat, name) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().instantEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name)); \
+    } while (0)
+#define TRACE_INSTANT_ARGS(cat, name, ...) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().instantEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name), __VA_ARGS__); \
+    } while (0)
+#define TRACE_BEGIN(cat, name) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().beginEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name)); \
+    } while (0)
+#define TRACE_BEGIN_ARGS(cat, name, ...) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().beginEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name), __VA_ARGS__); \
+    } while (0)
+#define TRACE_END(cat, name) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().endEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name)); \
+    } while (0)
+#define TRACE_ID_EVENT(cat, name, type, id) do { \
+    if (Systrace::isEnabled(TRACE_CATEGORY(cat))) \
+        Systrace::get().idEvent(TRACE_CATEGORY(cat), TRACE_NAME_ID(name), type, id); \
+    } while (0)
+#define TRACE_FLOW_BEGIN(cat, name, id) TRACE_ID_EVENT(cat, name, 's', id)
+#define TRACE_FLOW_STEP(cat, name, id) TRACE_ID_EVENT(cat, name, 't', id)
+#define TRACE_FLOW_END(cat, name, id) TRACE_ID_EVENT(cat, name, 'f', id)
+#define TRACE_ASYNC_BEGIN(cat, name, id) TRACE_ID_EVENT(cat, name, 'b', id)
+#define TRACE_ASYNC_END(cat, name, id) TRACE_ID_EVENT(cat, name, 'e', id)
+#define TRACE_ENABLE_CATEGORIES(list) Systrace::enableCategories(list)
 #define TRACE_SAVE(filepath) Systrace::get().saveToFile(filepath)
+#define TRACE_SAVE_ASYNC(filepath) Systrace::get().saveToFileAsync(filepath)
+#define TRACE_START_STREAMING(filepath, max_memory) Systrace::get().startStreaming(filepath, max_memory)
+#define TRACE_START_FLIGHT_RECORDER(filepath, size) Systrace::get().startFlightRecorder(filepath, size)
 #define TRACE_THREAD_ID() Systrace::get().getCurrentThreadId()
 #define TRACE_SET_THREAD_NAME(name) Systrace::get().setThreadName(name)
 #else
-#define TRACE_SCOPE(name) 
-#define TRACE_SCOPE_ARGS(name, args) 
-#define TRACE_FUNCTION() 
-#define TRACE_FUNCTION_ARGS(args) 
-#define TRACE_COUNTER(name, value) 
+#define TRACE_CATEGORY(cat)
+#define TRACE_NAME_ID(name)
+#define TRACE_ARG(key, value)
+#define TRACE_ENABLED() false
+#define TRACE_RECORDING() false
+#define TRACE_SET_MODE(name) false
+#define TRACE_SET_PERF_COUNTERS(enabled)
+#define TRACE_SCOPE(cat, name)
+#define TRACE_SCOPE_ARGS(cat, name, ...)
+#define TRACE_FUNCTION(cat)
+#define TRACE_FUNCTION_ARGS(cat, ...)
+#define TRACE_COUNTER(cat, name, value)
 #define TRACE_MEMORY(usage)
-#define TRACE_INSTANT(name)
-#define TRACE_INSTANT_ARGS(name, args)
-#define TRACE_BEGIN(name)
-#define TRACE_BEGIN_ARGS(name, args)
-#define TRACE_END(name)
+#define TRACE_INSTANT(cat, name)
+#define TRACE_INSTANT_ARGS(cat, name, ...)
+#define TRACE_BEGIN(cat, name)
+#define TRACE_BEGIN_ARGS(cat, name, ...)
+#define TRACE_END(cat, name)
+#define TRACE_ID_EVENT(cat, name, type, id)
+#define TRACE_FLOW_BEGIN(cat, name, id)
+#define TRACE_FLOW_STEP(cat, name, id)
+#define TRACE_FLOW_END(cat, name, id)
+#define TRACE_ASYNC_BEGIN(cat, name, id)
+#define TRACE_ASYNC_END(cat, name, id)
+#define TRACE_ENABLE_CATEGORIES(list) false
 #define TRACE_SAVE(filepath)
+#define TRACE_SAVE_ASYNC(filepath)
+#define TRACE_START_STREAMING(filepath, max_memory)
+#define TRACE_START_FLIGHT_RECORDER(filepath, size)
 #define TRACE_THREAD_ID()
 #define TRACE_SET_THREAD_NAME(name)
 #endif
 
-#endif // SYSTRACE_H
\ No newline at end of file
+#endif // SYSTRACE_H
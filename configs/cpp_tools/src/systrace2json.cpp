@@ -0,0 +1,98 @@
+// 把 Systrace 流式模式写出的二进制跟踪文件，或飞行记录模式残留的 mmap 文件，
+// 转换为 Chrome/Perfetto JSON
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include "systrace_format.h"
+#include "systrace_flight.h"
+
+namespace {
+
+template <typename T>
+bool read_pod(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+bool read_trace(std::istream& in, TraceContents& data) {
+    TraceFileHeader header;
+    if (!read_pod(in, header) || std::memcmp(header.magic, kTraceFileMagic, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a Systrace binary file" << std::endl;
+        return false;
+    }
+    if (header.version != kTraceFileVersion || header.event_size != sizeof(TraceEvent)) {
+        std::cerr << "Unsupported trace version " << header.version
+                  << " (event size " << header.event_size << ")" << std::endl;
+        return false;
+    }
+
+    TraceRecordHeader record;
+    std::string payload;
+    while (read_pod(in, record)) {
+        payload.resize(record.size);
+        if (!in.read(payload.data(), record.size)) {
+            // 进程异常退出时最后一条记录可能不完整
+            std::cerr << "Warning: truncated record at end of file" << std::endl;
+            break;
+        }
+        if (!applyTraceRecord(data, record.kind, payload.data(), payload.size())) {
+            std::cerr << "Warning: skipping invalid record of kind "
+                      << static_cast<uint32_t>(record.kind) << std::endl;
+        }
+    }
+    return true;
+}
+
+/// 飞行记录文件：整个读入内存后从各线程的环形缓冲区恢复事件
+bool read_flight(std::istream& in, TraceContents& data) {
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string error;
+    if (!readTraceFlight(contents.data(), contents.size(), data, error)) {
+        std::cerr << "Failed to recover flight record: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <trace.bin|trace.flight> <trace.json>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    char magic[sizeof(kTraceFlightMagic)] = {};
+    in.read(magic, sizeof(magic));
+    bool flight = isTraceFlightFile(magic, static_cast<size_t>(in.gcount()));
+    in.clear();
+    in.seekg(0);
+
+    TraceContents data;
+    if (!(flight ? read_flight(in, data) : read_trace(in, data))) {
+        return EXIT_FAILURE;
+    }
+
+    std::FILE* out = std::fopen(argv[2], "wb");
+    if (!out) {
+        std::cerr << "Failed to open: " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    size_t count = writeTraceJson(out, data);
+    std::fclose(out);
+
+    std::cout << "Converted " << count << " events to " << argv[2] << std::endl;
+    if (data.dropped > 0) {
+        std::cout << "Note: " << data.dropped << " events were dropped"
+                  << (flight ? " from threads without a ring" : " at the trace memory cap") << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+// Systrace 分配统计：替换全局 operator new/delete，按线程和 AutoTrace 作用域统计堆分配。
+// 可选组件，链接进程序后 TraceAlloc::hooked() 为 true（CMake 选项 SYSTRACE_ALLOC_HOOKS）。
+#include <new>
+#include <cstdlib>
+#include "systrace_alloc.h"
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define SYSTRACE_USABLE_SIZE(p) _msize(p)
+#else
+#include <malloc.h>
+#define SYSTRACE_USABLE_SIZE(p) malloc_usable_size(p)
+#endif
+
+namespace {
+
+[[maybe_unused]] const bool registered = (TraceAlloc::hooked_ = true);
+
+void* allocate(size_t size, size_t alignment, bool nothrow) {
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        void* p = nullptr;
+#if defined(_WIN32)
+        p = alignment > alignof(std::max_align_t) ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+        if (alignment > alignof(std::max_align_t)) {
+            if (posix_memalign(&p, alignment, size) != 0) {
+                p = nullptr;
+            }
+        } else {
+            p = std::malloc(size);
+        }
+#endif
+        if (p) {
+            TraceAlloc::onAlloc(SYSTRACE_USABLE_SIZE(p));
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            if (nothrow) {
+                return nullptr;
+            }
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void release(void* p, size_t alignment) {
+    if (!p) {
+        return;
+    }
+    TraceAlloc::onFree(SYSTRACE_USABLE_SIZE(p));
+#if defined(_WIN32)
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void)alignment;
+#endif
+    std::free(p);
+}
+
+constexpr size_t kDefaultAlign = alignof(std::max_align_t);
+
+} // namespace
+
+void* operator new(size_t size) { return allocate(size, kDefaultAlign, false); }
+void* operator new[](size_t size) { return allocate(size, kDefaultAlign, false); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size, kDefaultAlign, true); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size, kDefaultAlign, true); }
+void* operator new(size_t size, std::align_val_t al) { return allocate(size, static_cast<size_t>(al), false); }
+void* operator new[](size_t size, std::align_val_t al) { return allocate(size, static_cast<size_t>(al), false); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(al), true);
+}
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(al), true);
+}
+
+void operator delete(void* p) noexcept { release(p, kDefaultAlign); }
+void operator delete[](void* p) noexcept { release(p, kDefaultAlign); }
+void operator delete(void* p, size_t) noexcept { release(p, kDefaultAlign); }
+void operator delete[](void* p, size_t) noexcept { release(p, kDefaultAlign); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p, kDefaultAlign); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p, kDefaultAlign); }
+void operator delete(void* p, std::align_val_t al) noexcept { release(p, static_cast<size_t>(al)); }
+void operator delete[](void* p, std::align_val_t al) noexcept { release(p, static_cast<size_t>(al)); }
+void operator delete(void* p, size_t, std::align_val_t al) noexcept { release(p, static_cast<size_t>(al)); }
+void operator delete[](void* p, size_t, std::align_val_t al) noexcept { release(p, static_cast<size_t>(al)); }
+void operator delete(void* p, std::align_val_t al, const std::nothrow_t&) noexcept {
+    release(p, static_cast<size_t>(al));
+}
+void operator delete[](void* p, std::align_val_t al, const std::nothrow_t&) noexcept {
+    release(p, static_cast<size_t>(al));
+}
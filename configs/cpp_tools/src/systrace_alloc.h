@@ -0,0 +1,70 @@
+#ifndef SYSTRACE_ALLOC_H
+#define SYSTRACE_ALLOC_H
+
+#include <cstdint>
+#include <cstddef>
+
+/// 一段时间内的堆分配统计
+struct TraceAllocStats {
+    uint64_t bytes = 0;         ///< 分配的字节数 (按实际可用大小)
+    uint64_t count = 0;         ///< 分配次数
+    uint64_t freed_bytes = 0;
+    uint64_t frees = 0;
+};
+
+/**
+ * @brief 线程私有的堆分配统计，由 systrace_alloc.cpp 中的 operator new/delete 钩子更新
+ *
+ * 没有链接 systrace_alloc.cpp 时 hooked() 为 false，统计始终为零。
+ * 每次分配和释放同时计入线程合计和当前最内层的 AutoTrace 作用域；
+ * 释放计入执行释放时所在的作用域。
+ */
+class TraceAlloc {
+public:
+    using Stats = TraceAllocStats;
+
+    static bool hooked() { return hooked_; }
+
+    /// 当前线程的累计统计
+    static const Stats& totals() { return totals_; }
+
+    /**
+     * @brief 把之后的分配记到 scope 上，返回之前的作用域供 leaveScope 恢复
+     */
+    static Stats* enterScope(Stats* scope) {
+        Stats* parent = scope_;
+        scope_ = scope;
+        return parent;
+    }
+
+    static void leaveScope(Stats* parent) {
+        scope_ = parent;
+    }
+
+    static void onAlloc(size_t bytes) {
+        totals_.bytes += bytes;
+        ++totals_.count;
+        if (scope_) {
+            scope_->bytes += bytes;
+            ++scope_->count;
+        }
+    }
+
+    static void onFree(size_t bytes) {
+        totals_.freed_bytes += bytes;
+        ++totals_.frees;
+        if (scope_) {
+            scope_->freed_bytes += bytes;
+            ++scope_->frees;
+        }
+    }
+
+    static inline bool hooked_ = false;     ///< systrace_alloc.cpp 在静态初始化时置位
+
+private:
+    // 平凡类型、常量初始化，钩子中访问不会触发 TLS 初始化
+    static inline thread_local Stats totals_{};
+    static inline thread_local Stats* scope_ = nullptr;
+};
+
+#endif // SYSTRACE_ALLOC_H
@@ -0,0 +1,138 @@
+#ifndef SYSTRACE_CLOCK_H
+#define SYSTRACE_CLOCK_H
+
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define SYSTRACE_HAS_TSC 1
+#endif
+
+#if defined(__linux__) || defined(__CYGWIN__)
+#include <time.h>
+#endif
+
+/**
+ * @brief Systrace 使用的时钟源，返回纳秒时间戳
+ *
+ * x86-64 Linux 上如果 CPU 支持不变 TSC，读取 rdtsc 并在启动时对照 CLOCK_MONOTONIC 校准；
+ * 其他平台或设置环境变量 SYSTRACE_CLOCK=monotonic 时退回 clock_gettime / steady_clock。
+ * 两种时钟源都与 CLOCK_MONOTONIC 共用起点，同一进程内可以直接比较。
+ */
+class TraceClock {
+public:
+    enum class Source { Tsc, Monotonic };
+
+    static TraceClock& get() {
+        static TraceClock instance;
+        return instance;
+    }
+
+    /// 当前时间 (纳秒)
+    int64_t now() const {
+#ifdef SYSTRACE_HAS_TSC
+        if (source_ == Source::Tsc) {
+            uint64_t delta = __rdtsc() - base_tsc_;
+            return base_ns_ + static_cast<int64_t>((static_cast<unsigned __int128>(delta) * mult_) >> kShift);
+        }
+#endif
+        return monotonicNs();
+    }
+
+    Source source() const { return source_; }
+
+    const char* sourceName() const {
+        return source_ == Source::Tsc ? "tsc" : "monotonic";
+    }
+
+    /// 切换时钟源；请求 TSC 但不可用时保持单调时钟
+    void setSource(Source source) {
+#ifdef SYSTRACE_HAS_TSC
+        if (source == Source::Tsc && mult_ != 0) {
+            source_ = Source::Tsc;
+            return;
+        }
+#endif
+        (void)source;
+        source_ = Source::Monotonic;
+    }
+
+    static int64_t monotonicNs() {
+#if defined(__linux__) || defined(__CYGWIN__)
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+private:
+    static constexpr int kShift = 32;   ///< mult_ 为 32.32 定点的每 tick 纳秒数
+
+    TraceClock() {
+#ifdef SYSTRACE_HAS_TSC
+        if (hasInvariantTsc()) {
+            calibrate();
+        }
+#endif
+        const char* env = std::getenv("SYSTRACE_CLOCK");
+        setSource(env && std::strcmp(env, "monotonic") == 0 ? Source::Monotonic : Source::Tsc);
+    }
+
+#ifdef SYSTRACE_HAS_TSC
+    /// CPUID.80000007H:EDX[8]，TSC 频率不随频率调节和睡眠状态变化
+    static bool hasInvariantTsc() {
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007) {
+            return false;
+        }
+        __cpuid(0x80000007, eax, ebx, ecx, edx);
+        return (edx & (1u << 8)) != 0;
+    }
+
+    /// 读取一对尽量同时刻的 (CLOCK_MONOTONIC, TSC)，取 TSC 区间最短的一次
+    static void samplePair(int64_t& ns, uint64_t& tsc) {
+        uint64_t best = UINT64_MAX;
+        for (int i = 0; i < 5; ++i) {
+            uint64_t t0 = __rdtsc();
+            int64_t mono = monotonicNs();
+            uint64_t t1 = __rdtsc();
+            if (t1 - t0 < best) {
+                best = t1 - t0;
+                ns = mono;
+                tsc = t0 + (t1 - t0) / 2;
+            }
+        }
+    }
+
+    void calibrate() {
+        int64_t ns0 = 0, ns1 = 0;
+        uint64_t tsc0 = 0, tsc1 = 0;
+        samplePair(ns0, tsc0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        samplePair(ns1, tsc1);
+        if (tsc1 <= tsc0 || ns1 <= ns0) {
+            return;
+        }
+        mult_ = (static_cast<unsigned __int128>(ns1 - ns0) << kShift) / (tsc1 - tsc0);
+        base_ns_ = ns1;
+        base_tsc_ = tsc1;
+    }
+#endif
+
+    Source source_ = Source::Monotonic;
+#ifdef SYSTRACE_HAS_TSC
+    int64_t base_ns_ = 0;
+    uint64_t base_tsc_ = 0;
+    unsigned __int128 mult_ = 0;
+#endif
+};
+
+#endif // SYSTRACE_CLOCK_H
@@ -0,0 +1,290 @@
+#ifndef SYSTRACE_FLIGHT_H
+#define SYSTRACE_FLIGHT_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include "systrace_format.h"
+
+#if defined(__linux__) || defined(__CYGWIN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define SYSTRACE_HAS_FLIGHT 1
+#endif
+
+// ===================== 飞行记录器文件格式 =====================
+//
+//   TraceFlightHeader
+//   元数据区: TraceRecordHeader + payload ... (只有 Name / ThreadName 记录)
+//   槽 0: TraceFlightSlot + TraceEvent[slot_events]
+//   槽 1: ...
+//
+// 文件以 MAP_SHARED 映射，写入直接落在页缓存中，进程崩溃或被 OOM 杀死后内容仍在文件里。
+// 每个线程独占一个槽，槽内是环形缓冲区，只保留最近的 slot_events 个事件（环绕后读取时可恢复 slot_events - 1 个）。
+
+constexpr char kTraceFlightMagic[8] = {'S', 'Y', 'S', 'F', 'L', 'I', 'G', 'T'};
+constexpr uint32_t kTraceFlightVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "flight recorder needs address-free atomics");
+
+struct TraceFlightHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;                ///< sizeof(TraceEvent)，用于校验
+    uint32_t slot_count;
+    uint32_t slot_events;               ///< 每个槽的环形缓冲区容量
+    uint64_t meta_offset;
+    uint64_t meta_capacity;
+    uint64_t slots_offset;
+    uint64_t slot_size;                 ///< 每个槽的字节数（含槽头）
+    std::atomic<uint64_t> meta_size;    ///< 元数据区已发布的字节数
+    std::atomic<uint32_t> slots_used;   ///< 已分配的槽数
+    uint32_t reserved;
+    std::atomic<uint64_t> dropped;      ///< 没有分配到槽的线程丢弃的事件数
+};
+
+struct TraceFlightSlot {
+    std::atomic<uint32_t> tid;
+    uint32_t reserved;
+    std::atomic<uint64_t> written;      ///< 累计写入的事件数，写入第 n 个事件后发布 n
+};
+
+/**
+ * @brief 单个线程的环形事件缓冲区，只有所属线程写入
+ */
+class TraceFlightRing {
+public:
+    TraceFlightRing() = default;
+
+    TraceFlightRing(TraceFlightSlot* slot, uint32_t capacity)
+        : slot_(slot), events_(reinterpret_cast<TraceEvent*>(slot + 1)), capacity_(capacity),
+          written_(slot->written.load(std::memory_order_relaxed)) {}
+
+    /// 下一个事件槽，覆盖最旧的事件
+    TraceEvent* reserve() {
+        return &events_[written_ % capacity_];
+    }
+
+    /// 发布 reserve 返回的事件
+    void commit() {
+        slot_->written.store(++written_, std::memory_order_release);
+    }
+
+private:
+    TraceFlightSlot* slot_ = nullptr;
+    TraceEvent* events_ = nullptr;
+    uint32_t capacity_ = 0;
+    uint64_t written_ = 0;
+};
+
+/**
+ * @brief 飞行记录器：把各线程事件写入 mmap 文件中的定长环形缓冲区
+ *
+ * 文件大小固定，平分给 max_threads 个槽；名称和线程名称追加到元数据区。
+ * 进程异常退出后可用 systrace2json 从残留文件恢复 JSON。
+ */
+class TraceFlightRecorder {
+public:
+    static constexpr size_t kMetaCapacity = 256u << 10;  ///< 元数据区大小
+    static constexpr uint32_t kDefaultThreads = 32;
+
+    TraceFlightRecorder() = default;
+
+    ~TraceFlightRecorder() {
+        close();
+    }
+
+    TraceFlightRecorder(const TraceFlightRecorder&) = delete;
+    TraceFlightRecorder& operator=(const TraceFlightRecorder&) = delete;
+
+    /**
+     * @brief 创建并映射飞行记录文件
+     * @param path 文件路径，已存在时覆盖
+     * @param size 文件总字节数
+     * @param max_threads 槽数，超出的线程事件被丢弃并计数
+     * @return 创建或映射失败、或文件太小容纳不下槽时返回 false
+     */
+    bool open(const std::string& path, size_t size, uint32_t max_threads = kDefaultThreads) {
+#ifdef SYSTRACE_HAS_FLIGHT
+        size_t slots_offset = align(sizeof(TraceFlightHeader) + kMetaCapacity);
+        if (max_threads == 0 || size <= slots_offset) {
+            return false;
+        }
+        size_t slot_size = (size - slots_offset) / max_threads / 64 * 64;
+        if (slot_size < sizeof(TraceFlightSlot) + 16 * sizeof(TraceEvent)) {
+            return false;
+        }
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+        base_ = static_cast<char*>(base);
+        size_ = size;
+
+        // 文件由 ftruncate 填零，原子成员的零值即初始状态
+        header_ = reinterpret_cast<TraceFlightHeader*>(base_);
+        header_->version = kTraceFlightVersion;
+        header_->event_size = sizeof(TraceEvent);
+        header_->slot_count = max_threads;
+        header_->slot_events = static_cast<uint32_t>((slot_size - sizeof(TraceFlightSlot)) / sizeof(TraceEvent));
+        header_->meta_offset = sizeof(TraceFlightHeader);
+        header_->meta_capacity = kMetaCapacity;
+        header_->slots_offset = slots_offset;
+        header_->slot_size = slot_size;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header_->magic, kTraceFlightMagic, sizeof(header_->magic));
+        return true;
+#else
+        (void)path;
+        (void)size;
+        (void)max_threads;
+        return false;
+#endif
+    }
+
+    /// 解除映射，文件保留
+    void close() {
+#ifdef SYSTRACE_HAS_FLIGHT
+        if (base_) {
+            munmap(base_, size_);
+            base_ = nullptr;
+            header_ = nullptr;
+        }
+#endif
+    }
+
+    bool isOpen() const { return base_ != nullptr; }
+
+    const char* data() const { return base_; }
+    size_t size() const { return size_; }
+    uint32_t slotEvents() const { return header_->slot_events; }
+
+    /**
+     * @brief 为线程分配一个槽
+     * @return 槽已用完时返回 false，该线程的事件应丢弃
+     */
+    bool claimSlot(uint32_t tid, TraceFlightRing& ring) {
+        uint32_t index = header_->slots_used.fetch_add(1, std::memory_order_relaxed);
+        if (index >= header_->slot_count) {
+            header_->slots_used.store(header_->slot_count, std::memory_order_relaxed);
+            return false;
+        }
+        auto* slot = reinterpret_cast<TraceFlightSlot*>(base_ + header_->slots_offset + index * header_->slot_size);
+        slot->tid.store(tid, std::memory_order_release);
+        ring = TraceFlightRing(slot, header_->slot_events);
+        return true;
+    }
+
+    /// 记录没有槽的线程丢弃的事件
+    void addDropped(uint64_t count) {
+        header_->dropped.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 追加名称或线程名称记录，元数据区满时忽略
+     */
+    void appendString(TraceRecordKind kind, uint32_t id, const std::string& value) {
+        std::lock_guard<std::mutex> lock(meta_mutex_);
+        uint64_t used = header_->meta_size.load(std::memory_order_relaxed);
+        TraceRecordHeader record{kind, static_cast<uint32_t>(sizeof(id) + value.size())};
+        if (used + sizeof(record) + record.size > header_->meta_capacity) {
+            return;
+        }
+        char* out = base_ + header_->meta_offset + used;
+        std::memcpy(out, &record, sizeof(record));
+        std::memcpy(out + sizeof(record), &id, sizeof(id));
+        std::memcpy(out + sizeof(record) + sizeof(id), value.data(), value.size());
+        header_->meta_size.store(used + sizeof(record) + record.size, std::memory_order_release);
+    }
+
+private:
+    static size_t align(size_t value) {
+        return (value + 4095) & ~static_cast<size_t>(4095);
+    }
+
+    char* base_ = nullptr;
+    size_t size_ = 0;
+    TraceFlightHeader* header_ = nullptr;
+    std::mutex meta_mutex_;
+};
+
+/// 数据是否以飞行记录文件的魔数开头
+inline bool isTraceFlightFile(const char* data, size_t size) {
+    return size >= sizeof(kTraceFlightMagic) && std::memcmp(data, kTraceFlightMagic, sizeof(kTraceFlightMagic)) == 0;
+}
+
+/**
+ * @brief 从飞行记录文件内容（运行中的映射或崩溃后残留的文件）读出各线程最近的事件
+ * @param error 失败原因
+ *
+ * 写入线程在发布计数前崩溃时，正在覆盖的最旧事件可能不完整，环形缓冲区写满时跳过该事件。
+ */
+inline bool readTraceFlight(const char* data, size_t size, TraceContents& contents, std::string& error) {
+    if (!isTraceFlightFile(data, size) || size < sizeof(TraceFlightHeader)) {
+        error = "not a Systrace flight recorder file";
+        return false;
+    }
+    const auto* header = reinterpret_cast<const TraceFlightHeader*>(data);
+    if (header->version != kTraceFlightVersion || header->event_size != sizeof(TraceEvent)) {
+        error = "unsupported flight recorder version " + std::to_string(header->version) +
+                " (event size " + std::to_string(header->event_size) + ")";
+        return false;
+    }
+    uint64_t meta_size = header->meta_size.load(std::memory_order_acquire);
+    if (header->meta_offset + std::min(meta_size, header->meta_capacity) > size ||
+        header->slots_offset + static_cast<uint64_t>(header->slot_count) * header->slot_size > size) {
+        error = "flight recorder file is truncated";
+        return false;
+    }
+
+    const char* meta = data + header->meta_offset;
+    uint64_t offset = 0;
+    while (offset + sizeof(TraceRecordHeader) <= meta_size) {
+        TraceRecordHeader record;
+        std::memcpy(&record, meta + offset, sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.size > meta_size) {
+            break;
+        }
+        applyTraceRecord(contents, record.kind, meta + offset, record.size);
+        offset += record.size;
+    }
+
+    uint32_t slots = std::min(header->slots_used.load(std::memory_order_acquire), header->slot_count);
+    for (uint32_t i = 0; i < slots; ++i) {
+        const auto* slot = reinterpret_cast<const TraceFlightSlot*>(data + header->slots_offset + i * header->slot_size);
+        uint32_t tid = slot->tid.load(std::memory_order_acquire);
+        uint64_t written = slot->written.load(std::memory_order_acquire);
+        if (tid == 0 || written == 0) {
+            continue;
+        }
+        const auto* ring = reinterpret_cast<const TraceEvent*>(slot + 1);
+        uint64_t capacity = header->slot_events;
+        // 写入方先填 events[written % capacity] 再发布，环绕后这个最旧的槽可能正被覆盖、
+        // 崩溃时只写了一半，因此跳过它，最多恢复 capacity - 1 个事件
+        uint64_t first = written >= capacity ? written - capacity + 1 : 0;
+        auto& events = contents.events[tid];
+        events.reserve(events.size() + (written - first));
+        for (uint64_t n = first; n < written; ++n) {
+            events.push_back(ring[n % capacity]);
+        }
+    }
+    contents.dropped = header->dropped.load(std::memory_order_relaxed);
+    return true;
+}
+
+#endif // SYSTRACE_FLIGHT_H
@@ -0,0 +1,559 @@
+#ifndef SYSTRACE_FORMAT_H
+#define SYSTRACE_FORMAT_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+/**
+ * @brief Systrace 事件记录和二进制跟踪文件格式
+ *
+ * 运行时 (systrace.h) 与离线转换工具 (systrace2json.cpp) 共用本文件中的定义。
+ * 二进制文件按本机字节序写入，只用于同一台机器上的转换。
+ */
+
+constexpr size_t kTraceMaxArgs = 2;          ///< 每个事件最多携带的参数个数
+constexpr size_t kTraceShortStringSize = 24; ///< 字符串参数内联存储上限（含结尾 '\0'）
+
+/// 事件类别，按位组合；运行时通过 SYSTRACE_CATEGORIES 或命令行选择要记录的类别
+enum TraceCategory : uint16_t {
+    kTraceCatIo = 1u << 0,          ///< 文件读写
+    kTraceCatConvert = 1u << 1,     ///< 颜色转换
+    kTraceCatQueue = 1u << 2,       ///< 队列等待与入队
+    kTraceCatMem = 1u << 3,         ///< 内存计数
+    kTraceCatPipeline = 1u << 4,    ///< 线程生命周期、目录扫描、进度监控
+};
+
+constexpr const char* kTraceCategoryNames[] = {"io", "convert", "queue", "mem", "pipeline"};
+constexpr size_t kTraceCategoryCount = sizeof(kTraceCategoryNames) / sizeof(kTraceCategoryNames[0]);
+constexpr uint32_t kTraceCatAll = (1u << kTraceCategoryCount) - 1;
+
+/// 类别位对应的名称（取最低位）
+inline const char* traceCategoryName(uint16_t category) {
+    for (size_t i = 0; i < kTraceCategoryCount; ++i) {
+        if (category & (1u << i)) {
+            return kTraceCategoryNames[i];
+        }
+    }
+    return "default";
+}
+
+/// 参数值类型
+enum class TraceArgType : uint8_t { None, Int, Double, String };
+
+/**
+ * @brief 定长的键值参数，导出时才格式化为 JSON
+ *
+ * 键为驻留后的名称ID，字符串值超过 kTraceShortStringSize - 1 时截断。
+ */
+struct TraceArg {
+    uint32_t key;
+    TraceArgType type;
+    union {
+        int64_t i;
+        double d;
+        char s[kTraceShortStringSize];
+    };
+
+    /// 平凡构造，事件块和 AutoTrace 中的参数槽不需要清零
+    TraceArg() = default;
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    TraceArg(uint32_t k, T value) : key(k), type(TraceArgType::Int), i(static_cast<int64_t>(value)) {}
+
+    template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    TraceArg(uint32_t k, T value) : key(k), type(TraceArgType::Double), d(static_cast<double>(value)) {}
+
+    TraceArg(uint32_t k, const char* value) : key(k), type(TraceArgType::String) {
+        setString(value, std::strlen(value));
+    }
+
+    TraceArg(uint32_t k, const std::string& value) : key(k), type(TraceArgType::String) {
+        setString(value.data(), value.size());
+    }
+
+private:
+    void setString(const char* value, size_t len) {
+        len = std::min(len, kTraceShortStringSize - 1);
+        std::memcpy(s, value, len);
+        s[len] = '\0';
+    }
+};
+
+/// 性能计数器，见 systrace_perf.h
+enum TracePerfCounter : size_t {
+    kPerfTaskClock,         ///< 线程占用 CPU 的时间 (纳秒)
+    kPerfPageFaults,
+    kPerfContextSwitches,
+    kPerfCycles,
+    kPerfInstructions,
+    kPerfLlcMisses,
+    kTracePerfCounterCount
+};
+
+constexpr const char* kTracePerfCounterNames[kTracePerfCounterCount] = {
+    "task_clock_ns", "page_faults", "context_switches", "cycles", "instructions", "llc_misses"};
+
+/// 事件标志
+enum TraceEventFlags : uint8_t {
+    kTraceEventHasPerf = 1u << 0,   ///< X 事件后紧跟一条 P 事件，携带作用域内的计数器增量
+};
+
+/**
+ * @brief 跟踪事件类型（定长记录，不持有堆内存）
+ *
+ * 事件类型沿用 Chrome trace 的 ph 字段：
+ *   B/E 开始/结束，X 完整事件（带时长），I 即时，C 计数器，
+ *   s/t/f 流事件（跨线程箭头），b/e 异步区间。
+ * 另有内部类型 P：参数区保存 TracePerfDeltas，导出时并入前一条 X 事件的 args。
+ */
+struct TraceEvent {
+    int64_t ts;                 ///< 时间戳 (纳秒，TraceClock)
+    uint32_t name;              ///< 驻留后的事件名称ID
+    char type;                  ///< 事件类型
+    uint8_t argc : 4;           ///< 有效参数个数
+    uint8_t flags : 4;          ///< TraceEventFlags
+    uint16_t category;          ///< TraceCategory
+    union {
+        int64_t dur;            ///< X 事件的时长 (纳秒)
+        uint64_t id;            ///< 流事件和异步事件的关联ID
+    };
+    TraceArg args[kTraceMaxArgs]; ///< 额外参数
+};
+
+/// 事件类型是否带关联ID
+inline bool traceEventHasId(char type) {
+    return type == 's' || type == 't' || type == 'f' || type == 'b' || type == 'e';
+}
+
+static_assert(std::is_trivially_copyable<TraceEvent>::value, "TraceEvent must be memcpy-able");
+
+/// TracePerfDeltas::mask 中的标志位：软件计数器只统计了用户态（perf_event_paranoid 限制）
+constexpr uint32_t kTracePerfUserOnly = 1u << 31;
+
+/// P 事件的负载：一个作用域内各计数器的增量，mask 标出本线程可用的计数器
+struct TracePerfDeltas {
+    uint32_t mask;
+    uint64_t values[kTracePerfCounterCount];
+};
+
+static_assert(sizeof(TracePerfDeltas) <= sizeof(TraceEvent::args), "perf deltas must fit in event args");
+
+inline void traceStorePerf(TraceEvent& event, const TracePerfDeltas& deltas) {
+    std::memcpy(static_cast<void*>(event.args), &deltas, sizeof(deltas));
+}
+
+inline TracePerfDeltas traceLoadPerf(const TraceEvent& event) {
+    TracePerfDeltas deltas;
+    std::memcpy(&deltas, static_cast<const void*>(event.args), sizeof(deltas));
+    return deltas;
+}
+
+// ===================== 二进制文件格式 =====================
+//
+//   TraceFileHeader
+//   TraceRecordHeader + payload
+//   TraceRecordHeader + payload
+//   ...
+//
+// 同一线程的事件记录按写入顺序出现。X 事件在作用域结束时写入、时间戳为开始时间，
+// 因此线程内的事件只是近似按时间排序，Chrome/Perfetto 加载时会重新排序。
+// 带 kTraceEventHasPerf 标志的 X 事件与其后的 P 事件总在同一线程内相邻。
+
+constexpr char kTraceFileMagic[8] = {'S', 'Y', 'S', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t kTraceFileVersion = 4;
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;        ///< sizeof(TraceEvent)，用于校验
+};
+
+/// 记录类型
+enum class TraceRecordKind : uint32_t {
+    Name = 1,       ///< payload: uint32_t id + 名称字节
+    ThreadName = 2, ///< payload: uint32_t tid + 名称字节
+    Events = 3,     ///< payload: uint32_t tid + uint32_t count + TraceEvent[count]
+    Dropped = 4,    ///< payload: uint64_t 因内存上限被丢弃的事件数
+};
+
+struct TraceRecordHeader {
+    TraceRecordKind kind;
+    uint32_t size;              ///< payload 字节数
+};
+
+/// 离线读取得到的完整跟踪内容
+struct TraceContents {
+    std::vector<std::string> names;                       ///< 名称ID -> 字符串
+    std::map<uint32_t, std::string> thread_names;
+    std::map<uint32_t, std::vector<TraceEvent>> events;   ///< 每线程按写入顺序排列的事件
+    uint64_t dropped = 0;
+};
+
+/**
+ * @brief 把一条记录的 payload 合并进 contents
+ * @return 未知记录类型或 payload 长度不符时返回 false
+ */
+inline bool applyTraceRecord(TraceContents& contents, TraceRecordKind kind, const char* payload, size_t size) {
+    uint32_t id = 0;
+    if (size < sizeof(id)) {
+        return false;
+    }
+    std::memcpy(&id, payload, sizeof(id));
+    switch (kind) {
+        case TraceRecordKind::Name:
+            if (contents.names.size() <= id) {
+                contents.names.resize(id + 1);
+            }
+            contents.names[id].assign(payload + sizeof(id), size - sizeof(id));
+            return true;
+        case TraceRecordKind::ThreadName:
+            contents.thread_names[id].assign(payload + sizeof(id), size - sizeof(id));
+            return true;
+        case TraceRecordKind::Events: {
+            uint32_t count = 0;
+            if (size < sizeof(id) + sizeof(count)) {
+                return false;
+            }
+            std::memcpy(&count, payload + sizeof(id), sizeof(count));
+            if (size != sizeof(id) + sizeof(count) + count * sizeof(TraceEvent)) {
+                return false;
+            }
+            auto& events = contents.events[id];
+            size_t offset = events.size();
+            events.resize(offset + count);
+            std::memcpy(static_cast<void*>(events.data() + offset), payload + sizeof(id) + sizeof(count),
+                        count * sizeof(TraceEvent));
+            return true;
+        }
+        case TraceRecordKind::Dropped:
+            if (size != sizeof(contents.dropped)) {
+                return false;
+            }
+            std::memcpy(&contents.dropped, payload, sizeof(contents.dropped));
+            return true;
+    }
+    return false;
+}
+
+// ===================== 按时间归并 =====================
+
+/**
+ * @brief 按时间戳 k 路归并多个已排序的事件流
+ * @param cursors 每个线程一个游标，需提供 valid()、tid()、event() 和 next()
+ * @param fn 按全局时间顺序对每个事件调用 fn(tid, event)
+ *
+ * 每个线程的事件基本按写入时间排列，因此只需维护一个大小为线程数的最小堆，
+ * 不复制也不整体排序事件。时间戳相同的事件按游标顺序输出。
+ * X 事件以开始时间为时间戳但在结束时写入，输出中可能晚于其内部的事件，
+ * 查看器加载时会自行排序。
+ */
+template <typename Cursor, typename Fn>
+void mergeTraceStreams(std::vector<Cursor>& cursors, Fn&& fn) {
+    auto later = [&](size_t a, size_t b) {
+        int64_t ta = cursors[a].event().ts;
+        int64_t tb = cursors[b].event().ts;
+        return ta != tb ? ta > tb : a > b;
+    };
+    std::vector<size_t> heap;
+    heap.reserve(cursors.size());
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        if (cursors[i].valid()) {
+            heap.push_back(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Cursor& cursor = cursors[heap.back()];
+        fn(cursor.tid(), cursor.event());
+        cursor.next();
+        if (cursor.valid()) {
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else {
+            heap.pop_back();
+        }
+    }
+}
+
+// ===================== JSON 导出 =====================
+
+/// 按 JSON 字符串规则转义 [data, data+len) 并追加到 out（std::string 或 std::vector<char>），
+/// 其余控制字符写成 \u00XX
+template <typename Out>
+inline void traceAppendJsonEscaped(Out& out, const char* data, size_t len) {
+    static const char kHex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        const char c = data[i];
+        const char* escaped = nullptr;
+        switch (c) {
+            case '"': escaped = "\\\""; break;
+            case '\\': escaped = "\\\\"; break;
+            case '\b': escaped = "\\b"; break;
+            case '\f': escaped = "\\f"; break;
+            case '\n': escaped = "\\n"; break;
+            case '\r': escaped = "\\r"; break;
+            case '\t': escaped = "\\t"; break;
+            default: break;
+        }
+        if (escaped) {
+            out.insert(out.end(), escaped, escaped + 2);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            const char unicode[] = {'\\', 'u', '0', '0', kHex[(c >> 4) & 0xf], kHex[c & 0xf]};
+            out.insert(out.end(), unicode, unicode + sizeof(unicode));
+        } else {
+            out.push_back(c);
+        }
+    }
+}
+
+/**
+ * @brief 把事件写成 Chrome/Perfetto 可加载的 JSON 数组
+ *
+ * 整数和转义后的字符串直接格式化进一块大输出缓冲区，缓冲区满时整块写出，
+ * 不经过 iostream。带计数器的 X 事件暂存到同一线程的 P 事件到达后再写出，
+ * 计数器增量作为额外的 args；P 事件因内存上限被丢弃时 X 事件照常写出。
+ */
+class TraceJsonWriter {
+public:
+    static constexpr size_t kBufferSize = 4u << 20;
+
+    TraceJsonWriter(std::FILE* out, const std::vector<std::string>& names)
+        : out_(out), names_(names) {
+        buffer_.reserve(kBufferSize + 4096);
+        append("[\n");
+    }
+
+    ~TraceJsonWriter() {
+        flush();
+    }
+
+    TraceJsonWriter(const TraceJsonWriter&) = delete;
+    TraceJsonWriter& operator=(const TraceJsonWriter&) = delete;
+
+    /// 写入线程名称元数据事件
+    void writeThreadName(uint32_t tid, const std::string& name) {
+        separator();
+        append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":");
+        appendInt(tid);
+        append(",\"args\":{\"name\":\"");
+        appendEscaped(name.data(), name.size());
+        append("\"}}");
+    }
+
+    /// 写入一个事件
+    void writeEvent(uint32_t tid, const TraceEvent& event) {
+        if (!pending_.empty()) {
+            auto it = pending_.find(tid);
+            if (it != pending_.end()) {
+                TraceEvent complete = it->second;
+                pending_.erase(it);
+                if (event.type == 'P' && event.ts == complete.ts && event.name == complete.name) {
+                    TracePerfDeltas deltas = traceLoadPerf(event);
+                    writeRecord(tid, complete, &deltas);
+                    return;
+                }
+                writeRecord(tid, complete, nullptr);
+            }
+        }
+        if (event.type == 'P') {
+            return;     // 所属 X 事件已被丢弃
+        }
+        if (event.type == 'X' && (event.flags & kTraceEventHasPerf)) {
+            pending_[tid] = event;
+            return;
+        }
+        writeRecord(tid, event, nullptr);
+    }
+
+    /// 结束 JSON 数组并写出缓冲区
+    void finish() {
+        for (const auto& [tid, event] : pending_) {
+            writeRecord(tid, event, nullptr);
+        }
+        pending_.clear();
+        append("\n]");
+        flush();
+        std::fflush(out_);
+    }
+
+    /// 已写入的事件数（不含元数据）
+    size_t count() const { return count_; }
+
+private:
+    void writeRecord(uint32_t tid, const TraceEvent& event, const TracePerfDeltas* perf) {
+        separator();
+        append("{\"name\":\"");
+        appendName(event.name);
+        append("\",\"cat\":\"");
+        appendRaw(traceCategoryName(event.category));
+        append("\",\"ph\":\"");
+        buffer_.push_back(event.type);
+        append("\",\"ts\":");
+        appendMicros(event.ts);
+        if (event.type == 'X') {
+            append(",\"dur\":");
+            appendMicros(event.dur);
+        } else if (traceEventHasId(event.type)) {
+            append(",\"id\":");
+            appendInt(static_cast<int64_t>(event.id));
+            if (event.type == 'f') {
+                // 流终点绑定到包含它的切片
+                append(",\"bp\":\"e\"");
+            }
+        }
+        append(",\"pid\":0,\"tid\":");
+        appendInt(tid);
+
+        if (event.argc > 0 || (perf && perf->mask)) {
+            append(",\"args\":{");
+            bool first_arg = true;
+            for (uint8_t i = 0; i < event.argc && i < kTraceMaxArgs; ++i) {
+                const TraceArg& arg = event.args[i];
+                if (!first_arg) buffer_.push_back(',');
+                first_arg = false;
+                buffer_.push_back('"');
+                appendName(arg.key);
+                append("\":");
+                switch (arg.type) {
+                    case TraceArgType::Int: appendInt(arg.i); break;
+                    case TraceArgType::Double: appendDouble(arg.d); break;
+                    case TraceArgType::String:
+                        buffer_.push_back('"');
+                        appendEscaped(arg.s, strnlen(arg.s, kTraceShortStringSize));
+                        buffer_.push_back('"');
+                        break;
+                    default: append("null");
+                }
+            }
+            for (size_t i = 0; perf && i < kTracePerfCounterCount; ++i) {
+                if (perf->mask & (1u << i)) {
+                    if (!first_arg) buffer_.push_back(',');
+                    first_arg = false;
+                    buffer_.push_back('"');
+                    appendRaw(kTracePerfCounterNames[i]);
+                    append("\":");
+                    appendInt(static_cast<int64_t>(perf->values[i]));
+                }
+            }
+            if (perf && (perf->mask & kTracePerfUserOnly)) {
+                if (!first_arg) buffer_.push_back(',');
+                first_arg = false;
+                append("\"perf_user_only\":1");
+            }
+            buffer_.push_back('}');
+        }
+
+        buffer_.push_back('}');
+        ++count_;
+        if (buffer_.size() >= kBufferSize) {
+            flush();
+        }
+    }
+
+    void separator() {
+        if (!first_) append(",\n");
+        first_ = false;
+    }
+
+    void flush() {
+        if (!buffer_.empty()) {
+            std::fwrite(buffer_.data(), 1, buffer_.size(), out_);
+            buffer_.clear();
+        }
+    }
+
+    template <size_t N>
+    void append(const char (&literal)[N]) {
+        buffer_.insert(buffer_.end(), literal, literal + N - 1);
+    }
+
+    void appendRaw(const char* value) {
+        buffer_.insert(buffer_.end(), value, value + std::strlen(value));
+    }
+
+    void appendInt(int64_t value) {
+        char tmp[24];
+        auto result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        buffer_.insert(buffer_.end(), tmp, result.ptr);
+    }
+
+    /// 纳秒写成保留三位小数的微秒，JSON 的 ts/dur 单位为微秒
+    void appendMicros(int64_t ns) {
+        if (ns < 0) {
+            buffer_.push_back('-');
+            ns = -ns;
+        }
+        appendInt(ns / 1000);
+        int64_t frac = ns % 1000;
+        char tmp[4] = {'.', static_cast<char>('0' + frac / 100), static_cast<char>('0' + frac / 10 % 10),
+                       static_cast<char>('0' + frac % 10)};
+        buffer_.insert(buffer_.end(), tmp, tmp + sizeof(tmp));
+    }
+
+    void appendDouble(double value) {
+        char tmp[32];
+        auto result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        buffer_.insert(buffer_.end(), tmp, result.ptr);
+    }
+
+    void appendName(uint32_t id) {
+        if (id < names_.size()) {
+            appendEscaped(names_[id].data(), names_[id].size());
+        } else {
+            append("<unknown>");
+        }
+    }
+
+    void appendEscaped(const char* data, size_t len) {
+        traceAppendJsonEscaped(buffer_, data, len);
+    }
+
+    std::FILE* out_;
+    const std::vector<std::string>& names_;
+    std::vector<char> buffer_;
+    bool first_ = true;
+    size_t count_ = 0;
+    std::unordered_map<uint32_t, TraceEvent> pending_;  ///< tid -> 等待 P 事件的 X 事件
+};
+
+/**
+ * @brief 把离线读取的跟踪内容按时间归并写成 JSON
+ * @return 写入的事件数
+ */
+inline size_t writeTraceJson(std::FILE* out, const TraceContents& contents) {
+    /// 遍历单个线程事件数组的游标
+    struct Cursor {
+        uint32_t tid_;
+        const std::vector<TraceEvent>* events_;
+        size_t index_ = 0;
+
+        bool valid() const { return index_ < events_->size(); }
+        uint32_t tid() const { return tid_; }
+        const TraceEvent& event() const { return (*events_)[index_]; }
+        void next() { ++index_; }
+    };
+    std::vector<Cursor> cursors;
+    for (const auto& [tid, events] : contents.events) {
+        cursors.push_back({tid, &events});
+    }
+
+    TraceJsonWriter writer(out, contents.names);
+    for (const auto& [tid, name] : contents.thread_names) {
+        writer.writeThreadName(tid, name);
+    }
+    mergeTraceStreams(cursors, [&](uint32_t tid, const TraceEvent& event) {
+        writer.writeEvent(tid, event);
+    });
+    writer.finish();
+    return writer.count();
+}
+
+#endif // SYSTRACE_FORMAT_H
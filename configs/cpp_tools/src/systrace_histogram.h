@@ -0,0 +1,112 @@
+#ifndef SYSTRACE_HISTOGRAM_H
+#define SYSTRACE_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+/**
+ * @brief 固定内存的对数-线性 (HDR 风格) 延迟直方图，单位纳秒
+ *
+ * 每个 2 的幂区间再线性划分为 kSubBuckets 个桶，相对误差不超过 1/kSubBuckets。
+ * 只允许一个线程写入；计数使用 relaxed 原子读写（不是读改写指令），
+ * 其他线程可以随时读取一个近似一致的快照。
+ */
+class TraceHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr uint64_t kSubBuckets = 1u << kSubBucketBits;
+    static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    TraceHistogram() {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// 记录一个值，仅允许所属线程调用
+    void record(int64_t value) {
+        uint64_t v = value > 0 ? static_cast<uint64_t>(value) : 0;
+        bump(buckets_[bucketIndex(v)], 1);
+        bump(count_, 1);
+        bump(sum_, v);
+        if (v < min_.load(std::memory_order_relaxed)) min_.store(v, std::memory_order_relaxed);
+        if (v > max_.load(std::memory_order_relaxed)) max_.store(v, std::memory_order_relaxed);
+    }
+
+    /// 把另一个直方图累加到本直方图（用于跨线程汇总，调用方负责同步）
+    void merge(const TraceHistogram& other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            bump(buckets_[i], other.buckets_[i].load(std::memory_order_relaxed));
+        }
+        bump(count_, other.count());
+        bump(sum_, other.sum_.load(std::memory_order_relaxed));
+        if (other.min() < min()) min_.store(other.min(), std::memory_order_relaxed);
+        if (other.max() > max()) max_.store(other.max(), std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t min() const { return count() ? min_.load(std::memory_order_relaxed) : 0; }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t n = count();
+        return n ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    /**
+     * @brief 估算分位数
+     * @param q 0~1 之间的分位
+     * @return 所在桶的中点，并限制在 [min, max] 范围内
+     */
+    uint64_t percentile(double q) const {
+        uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t low = bucketLow(i);
+                uint64_t high = i + 1 < kBucketCount ? bucketLow(i + 1) : max();
+                uint64_t mid = low + (high - low) / 2;
+                return mid < min() ? min() : (mid > max() ? max() : mid);
+            }
+        }
+        return max();
+    }
+
+    static size_t bucketIndex(uint64_t v) {
+        if (v < kSubBuckets) {
+            return static_cast<size_t>(v);
+        }
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - kSubBucketBits;
+        return static_cast<size_t>(shift + 1) * kSubBuckets + ((v >> shift) & (kSubBuckets - 1));
+    }
+
+    static uint64_t bucketLow(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        uint64_t shift = index / kSubBuckets - 1;
+        return (kSubBuckets + index % kSubBuckets) << shift;
+    }
+
+private:
+    template <typename T>
+    static void bump(std::atomic<T>& value, uint64_t delta) {
+        value.store(static_cast<T>(value.load(std::memory_order_relaxed) + delta), std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> buckets_[kBucketCount];
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> max_{0};
+};
+
+#endif // SYSTRACE_HISTOGRAM_H
@@ -0,0 +1,169 @@
+#ifndef SYSTRACE_PERF_H
+#define SYSTRACE_PERF_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "systrace_format.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// 一次计数器快照
+struct TracePerfSample {
+    uint64_t values[kTracePerfCounterCount];
+};
+
+/**
+ * @brief 当前线程的 perf_event_open 计数器
+ *
+ * 软件计数器 (task-clock、page-faults、context-switches) 和硬件计数器
+ * (cycles、instructions、LLC misses) 各开一个事件组，每次快照各用一次 read()。
+ * 容器或虚拟机中硬件计数器常常打不开，此时只保留软件计数器；
+ * 两者都不可用时 available() 为 false。只统计本线程。
+ * 硬件计数器只统计用户态；上下文切换只发生在内核态，软件组先尝试包含内核态，
+ * perf_event_paranoid 不允许时退回只统计用户态并不再打开 context-switches，
+ * 此时 mask() 带 kTracePerfUserOnly 位。
+ */
+class TracePerfCounters {
+public:
+    /// 当前线程的计数器，首次调用时打开
+    static TracePerfCounters& forThread() {
+        thread_local TracePerfCounters counters;
+        return counters;
+    }
+
+    ~TracePerfCounters() {
+#ifdef __linux__
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    TracePerfCounters(const TracePerfCounters&) = delete;
+    TracePerfCounters& operator=(const TracePerfCounters&) = delete;
+
+    /// 是否有任何计数器可用
+    bool available() const {
+        return sw_leader_ >= 0 || hw_leader_ >= 0;
+    }
+
+    /// 某个计数器是否可用
+    bool available(size_t counter) const {
+        return fds_[counter] >= 0;
+    }
+
+    /// 可用计数器的位掩码 (1 << TracePerfCounter)，软件计数器只统计用户态时另带 kTracePerfUserOnly
+    uint32_t mask() const {
+        uint32_t mask = sw_leader_ >= 0 && sw_user_only_ ? kTracePerfUserOnly : 0;
+        for (size_t i = 0; i < kTracePerfCounterCount; ++i) {
+            if (fds_[i] >= 0) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+
+    /// 读取快照，不可用的计数器值为 0
+    void read(TracePerfSample& sample) const {
+        std::memset(&sample, 0, sizeof(sample));
+#ifdef __linux__
+        readGroup(sw_leader_, kPerfTaskClock, kPerfContextSwitches, sample);
+        readGroup(hw_leader_, kPerfCycles, kPerfLlcMisses, sample);
+#endif
+    }
+
+private:
+    TracePerfCounters() {
+        for (int& fd : fds_) {
+            fd = -1;
+        }
+#ifdef __linux__
+        sw_leader_ = open(kPerfTaskClock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, false);
+        if (sw_leader_ < 0) {
+            sw_user_only_ = true;
+            sw_leader_ = open(kPerfTaskClock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1, true);
+        }
+        open(kPerfPageFaults, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, sw_leader_, sw_user_only_);
+        if (!sw_user_only_) {
+            open(kPerfContextSwitches, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, sw_leader_, false);
+        }
+
+        hw_leader_ = open(kPerfCycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, true);
+        if (hw_leader_ >= 0) {
+            open(kPerfInstructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, hw_leader_, true);
+            open(kPerfLlcMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, hw_leader_, true);
+        }
+
+        enable(sw_leader_);
+        enable(hw_leader_);
+#endif
+    }
+
+#ifdef __linux__
+    /// 打开一个计数器；group 为 -1 时作为组长，user_only 时不统计内核态。失败时返回 -1
+    int open(size_t counter, uint32_t type, uint64_t config, int group, bool user_only) {
+        if (group < 0 && counter != kPerfTaskClock && counter != kPerfCycles) {
+            return -1;
+        }
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group < 0 ? 1 : 0;
+        attr.exclude_kernel = user_only ? 1 : 0;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+        int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_ID, &ids_[counter]);
+        }
+        fds_[counter] = fd;
+        return fd;
+    }
+
+    static void enable(int leader) {
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    /// 一次 read() 读取整组，按事件ID放回对应计数器
+    void readGroup(int leader, size_t first, size_t last, TracePerfSample& sample) const {
+        if (leader < 0) {
+            return;
+        }
+        struct {
+            uint64_t nr;
+            struct { uint64_t value; uint64_t id; } values[kTracePerfCounterCount];
+        } data;
+        if (::read(leader, &data, sizeof(data)) <= 0) {
+            return;
+        }
+        for (uint64_t i = 0; i < data.nr && i < kTracePerfCounterCount; ++i) {
+            for (size_t counter = first; counter <= last; ++counter) {
+                if (fds_[counter] >= 0 && ids_[counter] == data.values[i].id) {
+                    sample.values[counter] = data.values[i].value;
+                }
+            }
+        }
+    }
+#endif
+
+    int fds_[kTracePerfCounterCount];
+    uint64_t ids_[kTracePerfCounterCount] = {};
+    int sw_leader_ = -1;
+    int hw_leader_ = -1;
+    bool sw_user_only_ = false;
+};
+
+#endif // SYSTRACE_PERF_H